@@ -0,0 +1,197 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+
+//  Counts the calls made to the global allocator, and the time taken, when
+//  loading many programs and executing them once per request: first with
+//  images and registers allocated as usual, then with the images in a
+//  registry and the registers in the scratch arena.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../ctrm/arena.hpp"
+
+namespace
+{
+    std::atomic<std::size_t> allocations{ 0 };
+    
+    constexpr std::size_t programCount{ 20000 };
+    constexpr std::size_t requests{ 1000000 };
+    
+    //  Multiplication, followed by a different number of increments
+    std::string text(std::size_t n)
+    {
+        std::string result{ "L0 : R1- -> L1, L6\n"
+                            "L1 : R2- -> L2, L4\n"
+                            "L2 : R0+ -> L3\n"
+                            "L3 : R3+ -> L1\n"
+                            "L4 : R3- -> L5, L0\n"
+                            "L5 : R2+ -> L4\n" };
+        
+        //  Appended piece by piece, as GCC 12 warns wrongly with -Wrestrict
+        //  about prepending a character to a temporary string
+        for (std::size_t i{ 0 }; i < n % 32; ++i)
+        {
+            result.append("L").append(std::to_string(i + 6));
+            result.append(" : R0+ -> L").append(std::to_string(i + 7)).append("\n");
+        }
+        
+        return result.append("L").append(std::to_string(n % 32 + 6)).append(" : HALT");
+    }
+    
+    std::string name(std::size_t n)
+    {
+        return std::string{ "p" }.append(std::to_string(n));
+    }
+    
+    void report(std::string_view phase, std::string_view mode, std::size_t before,
+                std::chrono::steady_clock::time_point start)
+    {
+        const std::chrono::duration<double, std::milli> time{ std::chrono::steady_clock::now() - start };
+        std::cout << phase << ' ' << mode << ": " << allocations - before << " allocations, " << time.count()
+                  << " ms\n";
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    
+    if (void* p{ std::malloc(size == 0 ? 1 : size) })
+        return p;
+    
+    throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    ++allocations;
+    const auto align{ static_cast<std::size_t>(alignment) };
+    
+    if (void* p{ std::aligned_alloc(align, (size + align - 1) / align * align) })
+        return p;
+    
+    throw std::bad_alloc{};
+}
+
+//  Every form of delete frees with free(), matching the malloc() and
+//  aligned_alloc() above. Once a delete is inlined into a caller of the
+//  replaced new, GCC takes the pointer to come from the built-in new and
+//  warns that free() does not match it.
+#if __GNUC__ >= 11 && !__clang__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+#if __GNUC__ >= 11 && !__clang__
+#pragma GCC diagnostic pop
+#endif
+
+int main()
+{
+    std::vector<std::string> texts(programCount);
+    std::vector<std::string> names(programCount);
+    
+    for (std::size_t n{ 0 }; n < programCount; ++n)
+    {
+        texts[n] = text(n);
+        names[n] = name(n);
+    }
+    
+    std::uint64_t check{ 0 };
+    
+    {
+        std::size_t before{ allocations };
+        auto start{ std::chrono::steady_clock::now() };
+        std::unordered_map<std::string, ctrm::image> images;
+        
+        for (std::size_t n{ 0 }; n < programCount; ++n)
+            images.emplace(names[n], ctrm::load(texts[n]));
+        
+        report("load", "default", before, start);
+        before = allocations;
+        start = std::chrono::steady_clock::now();
+        
+        for (std::size_t request{ 0 }; request < requests; ++request)
+        {
+            const auto& p{ images.find(names[request % programCount])->second };
+            std::vector<std::uint64_t> registers(p.registerCount);
+            registers[1] = 3;
+            registers[2] = request % 16;
+            static_cast<void>(ctrm::run<std::uint64_t>(p, registers));
+            check += registers[0];
+        }
+        
+        report("requests", "default", before, start);
+    }
+    
+    {
+        std::size_t before{ allocations };
+        auto start{ std::chrono::steady_clock::now() };
+        ctrm::registry images;
+        
+        for (std::size_t n{ 0 }; n < programCount; ++n)
+            images.load(names[n], texts[n]);
+        
+        report("load", "arena", before, start);
+        before = allocations;
+        start = std::chrono::steady_clock::now();
+        
+        for (std::size_t request{ 0 }; request < requests; ++request)
+        {
+            const ctrm::scratchScope scope;
+            const auto& p{ *images.find(names[request % programCount]) };
+            auto registers{ ctrm::scratchRegisters<std::uint64_t>(p.registerCount) };
+            registers[1] = 3;
+            registers[2] = request % 16;
+            static_cast<void>(ctrm::run<std::uint64_t>(p, registers));
+            check -= registers[0];
+        }
+        
+        report("requests", "arena", before, start);
+    }
+    
+    return check == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+
+//  Measures runBatch() on a batch with many duplicate rows and a long tail
+//  of expensive ones, with and without deduplication and ordering by cost,
+//  and checks that every option leaves the same registers.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../ctrm/runtime.hpp"
+
+namespace
+{
+    //  Increments four registers in turn, 256 times in all, as many times
+    //  as the fifth register: the loop is too long to be executed in
+    //  constant time, so rows take time proportional to the fifth register.
+    std::string generated()
+    {
+        constexpr std::size_t body{ 256 };
+        std::string text{ "L0 : R4- -> L1, L" + std::to_string(body + 1) + '\n' };
+        
+        for (std::size_t i{ 1 }; i <= body; ++i)
+            text += 'L' + std::to_string(i) + " : R" + std::to_string(i % 4) + "+ -> L"
+                    + std::to_string(i == body ? 0 : i + 1) + '\n';
+        
+        return text + 'L' + std::to_string(body + 1) + " : HALT\n";
+    }
+}
+
+int main()
+{
+    constexpr std::size_t rows{ 1 << 16 };
+    constexpr std::size_t stride{ 5 };
+    const ctrm::image p{ ctrm::load(generated()) };
+    
+    //  Most rows repeat a few cheap inputs, and one in a thousand is a
+    //  hundred times as expensive
+    std::mt19937_64 random{ 1 };
+    std::vector<std::uint64_t> input(rows * stride);
+    
+    for (std::size_t row{ 0 }; row < rows; ++row)
+        input[row * stride + 4] = random() % 1000 == 0 ? 1000 + random() % 1000 : 1 + random() % 16;
+    
+    std::vector<std::uint64_t> expected;
+    
+    for (const bool deduplicate : { false, true })
+    {
+        for (const bool costOrder : { false, true })
+        {
+            std::vector<std::uint64_t> values{ input };
+            const auto start{ std::chrono::steady_clock::now() };
+            const auto s{ ctrm::runBatch<std::uint64_t>(p, values, stride, { .deduplicate = deduplicate,
+                                                                              .costOrder = costOrder }) };
+            const std::chrono::duration<double, std::milli> time{ std::chrono::steady_clock::now() - start };
+            
+            if (expected.empty())
+                expected = values;
+            
+            std::cout << (deduplicate ? "deduplicated" : "every row") << (costOrder ? ", ordered by cost: " : ": ")
+                      << time.count() << " ms for " << s.steps << " instructions"
+                      << (values == expected ? "" : " (different registers)") << '\n';
+        }
+    }
+    
+    return 0;
+}
@@ -0,0 +1,152 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+
+//  Measures the cost of executions which can be cancelled, compared with
+//  executions which cannot, for programs which are dispatch-bound (generated
+//  straight-line code), which execute loops in constant time, and which are
+//  short enough for the setup of each execution to matter. Also reports how
+//  long a long-running execution takes to stop once a stop is requested.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../ctrm/runtime.hpp"
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+    
+    struct benchmark
+    {
+        std::string name;
+        std::string text;
+        std::vector<std::uint64_t> registers;
+        std::size_t repeats;
+    };
+    
+    //  A generated program which increments four registers in turn, body
+    //  times in all, as many times as the fifth register. The loop is too
+    //  long to be executed in constant time, so every instruction is a
+    //  dispatch.
+    std::string generated(std::size_t body)
+    {
+        std::string text{ "L0 : R4- -> L1, L" + std::to_string(body + 1) + '\n' };
+        
+        for (std::size_t i{ 1 }; i <= body; ++i)
+            text += 'L' + std::to_string(i) + " : R" + std::to_string(i % 4) + "+ -> L"
+                    + std::to_string(i == body ? 0 : i + 1) + '\n';
+        
+        return text + 'L' + std::to_string(body + 1) + " : HALT\n";
+    }
+    
+    const std::vector<benchmark> benchmarks{
+            { "generated", generated(4096), { 0, 0, 0, 0, 16 }, 64 },
+            { "multiply", "L0 : R1- -> L1, L6\n"
+                          "L1 : R2- -> L2, L4\n"
+                          "L2 : R0+ -> L3\n"
+                          "L3 : R3+ -> L1\n"
+                          "L4 : R3- -> L5, L0\n"
+                          "L5 : R2+ -> L4\n"
+                          "L6 : HALT", { 0, 3000, 3000, 0 }, 256 },
+            { "add", "L0 : R1- -> L1, L2\n"
+                     "L1 : R0+ -> L0\n"
+                     "L2 : R2- -> L3, L4\n"
+                     "L3 : R0+ -> L2\n"
+                     "L4 : HALT", { 0, 3, 4 }, 1 << 16 },
+    };
+    
+    //  Nanoseconds per execution over one round of repeated executions.
+    template<typename Run>
+    double measure(const benchmark& b, Run run)
+    {
+        std::vector<std::uint64_t> values;
+        const auto start{ clock::now() };
+        
+        for (std::size_t i{ 0 }; i < b.repeats; ++i)
+        {
+            values = b.registers;
+            run(std::span<std::uint64_t>{ values });
+        }
+        
+        const std::chrono::duration<double, std::nano> time{ clock::now() - start };
+        return time.count() / static_cast<double>(b.repeats);
+    }
+}
+
+int main()
+{
+    constexpr int rounds{ 31 };
+    
+    for (const auto& b : benchmarks)
+    {
+        const ctrm::image p{ ctrm::load(b.text) };
+        const std::stop_source source;
+        const std::stop_token stop{ source.get_token() };
+        const auto end{ clock::now() + std::chrono::hours{ 1 } };
+        
+        //  The best of each, with the rounds interleaved so that all three
+        //  see the same noise
+        double plain{ std::numeric_limits<double>::max() };
+        double token{ plain };
+        double deadline{ plain };
+        
+        for (int round{ 0 }; round < rounds; ++round)
+        {
+            plain = std::min(plain, measure(b, [&](std::span<std::uint64_t> values) {
+                static_cast<void>(ctrm::run(p, values));
+            }));
+            
+            token = std::min(token, measure(b, [&](std::span<std::uint64_t> values) {
+                static_cast<void>(ctrm::run(p, values, stop));
+            }));
+            
+            deadline = std::min(deadline, measure(b, [&](std::span<std::uint64_t> values) {
+                static_cast<void>(ctrm::run(p, values, stop, end));
+            }));
+        }
+        
+        std::cout << b.name << ": " << plain << " ns uncancellable, " << token << " ns with a stop token ("
+                  << 100.0 * (token - plain) / plain << "%), " << deadline << " ns with a deadline ("
+                  << 100.0 * (deadline - plain) / plain << "%)\n";
+    }
+    
+    //  An execution which would take centuries, stopped from another thread
+    const ctrm::image p{ ctrm::load(generated(4096)) };
+    std::vector<std::uint64_t> values{ 0, 0, 0, 0, std::numeric_limits<std::uint64_t>::max() };
+    ctrm::cancellableStatus s{};
+    clock::time_point stopped;
+    
+    {
+        std::jthread worker{ [&](std::stop_token token) { s = ctrm::run(p, std::span{ values }, token); } };
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 100 });
+        stopped = clock::now();
+    }
+    
+    const std::chrono::duration<double, std::micro> latency{ clock::now() - stopped };
+    std::cout << "stopped after " << s.steps << " instructions (cancelled: " << s.cancelled << ") in " << latency.count()
+              << " us\n";
+    
+    return 0;
+}
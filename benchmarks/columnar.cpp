@@ -0,0 +1,85 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+//  Measures how much smaller the columnar format is than raw 64-bit
+//  registers for typical sweeps, and how quickly it is encoded and decoded
+//  compared to reading the raw registers from memory.
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "../ctrm/columnar.hpp"
+
+namespace
+{
+    struct sweep
+    {
+        std::string_view name;
+        std::size_t columns;
+        std::function<std::uint64_t(std::size_t row, std::size_t column)> value;
+    };
+    
+    const sweep sweeps[]{
+            { "grid", 4, [](std::size_t row, std::size_t column) -> std::uint64_t {
+                return column == 1 ? row / 1000 : column == 2 ? row % 1000 : 0;
+            } },
+            { "powers", 3, [](std::size_t row, std::size_t column) -> std::uint64_t {
+                return column == 1 ? std::uint64_t{ 1 } << (row % 40) : column == 2 ? row * 7 : 0;
+            } },
+            { "results", 1, [](std::size_t row, std::size_t) -> std::uint64_t {
+                return (row / 1000) * (row % 1000);
+            } },
+    };
+}
+
+int main()
+{
+    constexpr std::size_t rows{ 1 << 20 };
+    constexpr std::size_t blockSize{ 1 << 16 };
+    
+    for (const auto& s : sweeps)
+    {
+        std::vector<std::uint64_t> values(s.columns * rows);
+        
+        for (std::size_t row{ 0 }; row < rows; ++row)
+            for (std::size_t c{ 0 }; c < s.columns; ++c)
+                values[c * rows + row] = s.value(row, c);
+        
+        //  Blocks are taken from the same buffer, rows blockSize at a time
+        std::vector<std::byte> data;
+        auto start{ std::chrono::steady_clock::now() };
+        
+        for (std::size_t first{ 0 }; first < rows; first += blockSize)
+            ctrm::encodeBlock(data, std::span{ values }.subspan(first), s.columns, blockSize, rows);
+        
+        const double encode{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+        std::vector<std::uint64_t> decoded(s.columns * blockSize);
+        start = std::chrono::steady_clock::now();
+        
+        for (std::size_t offset{ 0 }; offset < data.size();)
+            offset += ctrm::decodeBlock(std::span{ data }.subspan(offset), decoded, s.columns, blockSize);
+        
+        const double decode{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+        const double raw{ static_cast<double>(values.size() * sizeof(std::uint64_t)) };
+        
+        std::cout << s.name << ": " << raw / static_cast<double>(data.size()) << "x smaller, encode "
+                  << raw / encode / 1e9 << " GB/s, decode " << raw / decode / 1e9 << " GB/s of registers\n";
+    }
+    
+    return 0;
+}
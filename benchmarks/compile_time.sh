@@ -0,0 +1,65 @@
+#!/bin/sh
+#  Compares the time taken to compile a project of many translation units
+#  which use ctrm::make, when each includes ctrm.hpp and when each imports
+#  the ctrm module. The module interface is compiled once, and its time is
+#  included in the total.
+#
+#  Usage: benchmarks/compile_time.sh [translation units] [compiler]
+#  Module flags default to those of GCC; set MODULE_FLAGS for other compilers.
+
+set -e
+
+units=${1:-200}
+cxx=${2:-${CXX:-g++}}
+module_flags=${MODULE_FLAGS:--fmodules-ts}
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+generate()
+{
+    i=0
+    while [ "$i" -lt "$units" ]
+    do
+        {
+            printf '%s\n' "$1"
+            printf 'constexpr auto program%s{ ctrm::make<3, 5>(\n' "$i"
+            printf '        "L0 : R1- -> L1, L2\\n"\n'
+            printf '        "L1 : R0+ -> L0\\n"\n'
+            printf '        "L2 : R2- -> L3, L4\\n"\n'
+            printf '        "L3 : R0+ -> L2\\n"\n'
+            printf '        "L4 : HALT") };\n'
+            printf 'unsigned long long unit%s() { return program%s.exec<unsigned long long>(%s, 1, 2); }\n' "$i" "$i" "$i"
+        } > "$2/unit$i.cpp"
+        i=$((i + 1))
+    done
+}
+
+now()
+{
+    date +%s.%N
+}
+
+mkdir "$work/header" "$work/module"
+generate "#include \"$root/ctrm.hpp\"" "$work/header"
+generate "import ctrm;" "$work/module"
+
+start=$(now)
+for unit in "$work"/header/*.cpp
+do
+    "$cxx" -std=c++20 -c "$unit" -o "${unit%.cpp}.o"
+done
+header=$(awk "BEGIN { print $(now) - $start }")
+
+cd "$work/module"
+start=$(now)
+"$cxx" -std=c++20 $module_flags -c -x c++ "$root/ctrm.cppm" -o ctrm.o
+for unit in ./*.cpp
+do
+    "$cxx" -std=c++20 $module_flags -c "$unit" -o "${unit%.cpp}.o"
+done
+module=$(awk "BEGIN { print $(now) - $start }")
+
+echo "translation units: $units"
+echo "#include \"ctrm.hpp\": ${header}s"
+echo "import ctrm:         ${module}s"
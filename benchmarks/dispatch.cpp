@@ -0,0 +1,103 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+//  Reports the number of dispatches made by the superinstruction engine
+//  compared to the number of instructions executed, for a set of
+//  representative programs, with superinstructions chosen from a static
+//  count of patterns and from a profile.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../ctrm/superinstructions.hpp"
+
+namespace
+{
+    struct benchmark
+    {
+        std::string name;
+        std::string text;
+        std::vector<std::uint64_t> registers;
+    };
+    
+    //  A generated program which sets registers to constants, without loops.
+    std::string constants(std::size_t count)
+    {
+        std::string text;
+        
+        for (std::size_t i{ 0 }; i < count; ++i)
+            text += 'L' + std::to_string(i) + " : R" + std::to_string(i % 4) + "+ -> L" + std::to_string(i + 1) + '\n';
+        
+        return text + 'L' + std::to_string(count) + " : HALT\n";
+    }
+    
+    const std::vector<benchmark> benchmarks{
+            { "constants", constants(4096), { 0, 0, 0, 0 } },
+            { "add", "L0 : R1- -> L1, L2\n"
+                     "L1 : R0+ -> L0\n"
+                     "L2 : R2- -> L3, L4\n"
+                     "L3 : R0+ -> L2\n"
+                     "L4 : HALT", { 0, 100000, 100000 } },
+            { "copy", "L0 : R1- -> L1, L4\n"
+                      "L1 : R0+ -> L2\n"
+                      "L2 : R2+ -> L3\n"
+                      "L3 : R3+ -> L0\n"
+                      "L4 : HALT", { 0, 100000, 0, 0 } },
+            { "multiply", "L0 : R1- -> L1, L6\n"
+                          "L1 : R2- -> L2, L4\n"
+                          "L2 : R0+ -> L3\n"
+                          "L3 : R3+ -> L1\n"
+                          "L4 : R3- -> L5, L0\n"
+                          "L5 : R2+ -> L4\n"
+                          "L6 : HALT", { 0, 300, 300, 0 } },
+            { "divide", "L0 : R2- -> L1, L2\n"
+                        "L1 : R3+ -> L0\n"
+                        "L2 : R3- -> L3, L5\n"
+                        "L3 : R1- -> L4, L6\n"
+                        "L4 : R2+ -> L2\n"
+                        "L5 : R0+ -> L0\n"
+                        "L6 : HALT", { 0, 100000, 7, 0 } },
+    };
+    
+    void report(const benchmark& b, std::string_view mode, const ctrm::fusedImage& f)
+    {
+        std::vector<std::uint64_t> values{ b.registers };
+        const auto start{ std::chrono::steady_clock::now() };
+        const auto s{ ctrm::run<std::uint64_t>(f, values) };
+        const double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+        
+        std::cout << b.name << ' ' << mode << ": " << s.steps << " instructions, " << s.dispatches
+                  << " dispatches (" << 100.0 - 100.0 * static_cast<double>(s.dispatches) / static_cast<double>(s.steps)
+                  << "% fewer), " << static_cast<double>(s.steps) / seconds / 1e6 << " million instructions/s\n";
+    }
+}
+
+int main()
+{
+    for (const auto& b : benchmarks)
+    {
+        const ctrm::image p{ ctrm::load(b.text) };
+        std::vector<std::uint64_t> values{ b.registers };
+        const auto counts{ ctrm::profile<std::uint64_t>(p, values) };
+        
+        report(b, "static", ctrm::fuse(p));
+        report(b, "profile", ctrm::fuse(p, counts));
+    }
+    
+    return 0;
+}
@@ -0,0 +1,205 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+
+//  Compares ordinary pages with huge pages for a large image executed in a
+//  random order, and for a large batch whose rows are executed in a random
+//  order, reporting the time taken, dTLB misses and page faults. Hardware
+//  counters are read with perf_event_open(), and are reported as unavailable
+//  where the kernel or a virtual machine does not provide them. Explicit huge
+//  pages must be reserved first, e.g. with
+//
+//      echo 512 > /proc/sys/vm/nr_hugepages
+//
+//  and fall back to transparent huge pages otherwise.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory_resource>
+#include <numeric>
+#include <random>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../ctrm/hugepages.hpp"
+#include "../ctrm/runtime.hpp"
+
+namespace
+{
+    //  A counter for the calling thread, or -1 if it is unavailable.
+    class counter
+    {
+    public:
+        counter(std::uint32_t type, std::uint64_t config)
+        {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = type;
+            attributes.config = config;
+            attributes.disabled = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            fd = static_cast<int>(::syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        }
+        
+        counter(const counter&) = delete;
+        counter& operator=(const counter&) = delete;
+        
+        ~counter()
+        {
+            if (fd >= 0)
+                ::close(fd);
+        }
+        
+        void start()
+        {
+            if (fd >= 0)
+            {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+        
+        [[nodiscard]]
+        long long stop()
+        {
+            long long value{ -1 };
+            
+            if (fd >= 0)
+            {
+                ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                
+                if (::read(fd, &value, sizeof(value)) != sizeof(value))
+                    value = -1;
+            }
+            
+            return value;
+        }
+    
+    private:
+        int fd;
+    };
+    
+    constexpr std::uint64_t dtlbMisses{ PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8
+                                        | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 };
+    
+    std::ostream& operator<<(std::ostream& out, const ctrm::hugePageResource& r)
+    {
+        if (r.mapped(ctrm::EXPLICIT_HUGE_PAGES) != 0)
+            return out << "explicit huge pages";
+        
+        if (r.mapped(ctrm::TRANSPARENT_HUGE_PAGES) != 0)
+            return out << "transparent huge pages";
+        
+        return out << "small pages";
+    }
+    
+    template<typename Run>
+    void measure(std::string_view name, const ctrm::hugePageResource& pages, Run run)
+    {
+        counter tlb{ PERF_TYPE_HW_CACHE, dtlbMisses };
+        counter faults{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS };
+        
+        tlb.start();
+        faults.start();
+        const auto start{ std::chrono::steady_clock::now() };
+        run();
+        const std::chrono::duration<double, std::milli> time{ std::chrono::steady_clock::now() - start };
+        const long long misses{ tlb.stop() };
+        const long long pageFaults{ faults.stop() };
+        
+        std::cout << name << " with " << pages << ": " << time.count() << " ms, ";
+        
+        if (misses < 0)
+            std::cout << "dTLB misses unavailable, ";
+        else
+            std::cout << misses << " dTLB misses, ";
+        
+        std::cout << pageFaults << " page faults\n";
+    }
+    
+    //  An image of increments which visits every line once, in a random
+    //  order, and then halts.
+    ctrm::image shuffled(std::size_t lines, std::pmr::memory_resource* resource)
+    {
+        std::vector<std::size_t> order(lines);
+        std::iota(order.begin(), order.end(), std::size_t{ 0 });
+        std::shuffle(order.begin() + 1, order.end(), std::mt19937_64{ 1 });
+        
+        ctrm::image result{ resource };
+        result.registerCount = 4;
+        result.instructions.resize(lines);
+        
+        for (std::size_t i{ 0 }; i < lines; ++i)
+            result.instructions[order[i]] = { i % 4, i + 1 < lines ? order[i + 1] : lines };
+        
+        result.analyse();
+        return result;
+    }
+}
+
+int main()
+{
+    constexpr std::size_t lines{ std::size_t{ 1 } << 22 };
+    constexpr std::size_t rows{ std::size_t{ 1 } << 22 };
+    constexpr std::size_t stride{ 4 };
+    
+    const ctrm::image add{ ctrm::load("L0 : R1- -> L1, L2\n"
+                                      "L1 : R0+ -> L0\n"
+                                      "L2 : R2- -> L3, L4\n"
+                                      "L3 : R0+ -> L2\n"
+                                      "L4 : HALT") };
+    
+    for (const auto mode : { ctrm::SMALL_PAGES, ctrm::TRANSPARENT_HUGE_PAGES, ctrm::EXPLICIT_HUGE_PAGES })
+    {
+        ctrm::hugePageResource pages{ mode };
+        
+        {
+            const ctrm::image p{ shuffled(lines, &pages) };
+            std::vector<std::uint64_t> values(p.registerCount);
+            
+            measure("image", pages, [&] {
+                for (int i{ 0 }; i < 4; ++i)
+                    static_cast<void>(ctrm::run<std::uint64_t>(p, values));
+            });
+        }
+        
+        {
+            //  Rows ordered by cost are executed in a random order, as their
+            //  costs are random
+            std::pmr::vector<std::uint64_t> values(rows * stride, &pages);
+            std::mt19937_64 random{ 2 };
+            
+            for (std::size_t row{ 0 }; row < rows; ++row)
+                values[row * stride + 1] = random() % 64;
+            
+            measure("batch", pages, [&] {
+                static_cast<void>(ctrm::runBatch<std::uint64_t>(add, values, stride, { .threads = 1, .costOrder = true }));
+            });
+        }
+    }
+    
+    return 0;
+}
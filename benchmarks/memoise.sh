@@ -0,0 +1,77 @@
+#!/bin/sh
+#  Compares the time taken to compile translation units which include a
+#  header using the same compile-time results in many places, when each use
+#  calls program.exec() and when each uses ctrm::result_v, which computes
+#  every distinct result once per translation unit.
+#
+#  Usage: benchmarks/memoise.sh [uses] [translation units] [compiler]
+
+set -e
+
+uses=${1:-400}
+units=${2:-4}
+cxx=${3:-${CXX:-g++}}
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+#  Sums 0 to n - 1, which takes time proportional to n to evaluate
+generate()
+{
+    {
+        printf '#pragma once\n'
+        printf '#include "%s/ctrm.hpp"\n' "$root"
+        printf 'inline constexpr auto triangle{ ctrm::make<3, 7>(\n'
+        printf '        "L0 : R1- -> L1, L6\\n"\n'
+        printf '        "L1 : R1- -> L2, L4\\n"\n'
+        printf '        "L2 : R2+ -> L3\\n"\n'
+        printf '        "L3 : R0+ -> L1\\n"\n'
+        printf '        "L4 : R2- -> L5, L0\\n"\n'
+        printf '        "L5 : R1+ -> L4\\n"\n'
+        printf '        "L6 : HALT") };\n'
+        i=0
+        while [ "$i" -lt "$uses" ]
+        do
+            n=$((500 + i % 4))
+            
+            if [ "$1" = exec ]
+            then
+                printf 'inline constexpr std::size_t use%s{ triangle.exec(0, %s) };\n' "$i" "$n"
+            else
+                printf 'inline constexpr std::size_t use%s{ ctrm::result_v<triangle, 0, %s> };\n' "$i" "$n"
+            fi
+            
+            i=$((i + 1))
+        done
+    } > "$2/results.hpp"
+    
+    i=0
+    while [ "$i" -lt "$units" ]
+    do
+        printf '#include "results.hpp"\nstd::size_t unit%s() { return use%s; }\n' "$i" "$i" > "$2/unit$i.cpp"
+        i=$((i + 1))
+    done
+}
+
+now()
+{
+    date +%s.%N
+}
+
+compile()
+{
+    start=$(now)
+    for unit in "$1"/*.cpp
+    do
+        "$cxx" -std=c++20 -c "$unit" -o "${unit%.cpp}.o"
+    done
+    awk "BEGIN { print $(now) - $start }"
+}
+
+mkdir "$work/exec" "$work/memoised"
+generate exec "$work/exec"
+generate memoised "$work/memoised"
+
+echo "uses: $uses (4 distinct results), translation units: $units"
+echo "program.exec():  $(compile "$work/exec")s"
+echo "ctrm::result_v:  $(compile "$work/memoised")s"
@@ -0,0 +1,119 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+
+//  A load generator for ctrm::scheduler: one tenant keeps a backlog of
+//  expensive executions while another submits small ones, one at a time.
+//  Reports the latency of the small executions when every execution shares
+//  one queue and runs to completion, and when the tenants share the worker
+//  fairly in time slices, along with the latency without the expensive
+//  executions.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../ctrm/scheduler.hpp"
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+    
+    //  Sums 0 to n - 1, which takes time proportional to n
+    const auto triangle{ std::make_shared<const ctrm::image>(ctrm::make<3, 7>(
+            "L0 : R1- -> L1, L6\n"
+            "L1 : R1- -> L2, L4\n"
+            "L2 : R2+ -> L3\n"
+            "L3 : R0+ -> L1\n"
+            "L4 : R2- -> L5, L0\n"
+            "L5 : R1+ -> L4\n"
+            "L6 : HALT")) };
+    
+    const auto add{ std::make_shared<const ctrm::image>(ctrm::make<3, 5>(
+            "L0 : R1- -> L1, L2\n"
+            "L1 : R0+ -> L0\n"
+            "L2 : R2- -> L3, L4\n"
+            "L3 : R0+ -> L2\n"
+            "L4 : HALT")) };
+    
+    constexpr std::size_t lightJobs{ 200 };
+    
+    void report(const char* name, std::chrono::steady_clock::duration slice, bool shared, std::size_t backlog)
+    {
+        ctrm::scheduler scheduler{ slice };
+        const std::size_t heavy{ scheduler.addTenant() };
+        const std::size_t light{ shared ? heavy : scheduler.addTenant() };
+        
+        //  Deadlines far in the future, in order of submission, make a
+        //  tenant's queue first in, first out
+        const auto submit{ [&](std::size_t tenant, const auto& p, std::vector<std::uint64_t> registers) {
+            return scheduler.submit(tenant, p, std::move(registers), std::numeric_limits<std::size_t>::max(),
+                                    clock::now() + std::chrono::hours{ 1 });
+        } };
+        
+        std::jthread worker{ [&](std::stop_token stop) { scheduler.serve(stop); } };
+        
+        //  Keeps a backlog of expensive executions, each taking about 20 ms
+        //  to run to completion
+        std::jthread load{ [&](std::stop_token stop) {
+            std::vector<std::future<ctrm::jobResult>> pending;
+            
+            while (!stop.stop_requested())
+            {
+                std::erase_if(pending, [](const auto& f) {
+                    return f.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready;
+                });
+                
+                while (pending.size() < backlog)
+                    pending.push_back(submit(heavy, triangle, { 0, 400'000, 0 }));
+                
+                std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+            }
+        } };
+        
+        std::vector<double> latencies;
+        
+        for (std::size_t i{ 0 }; i < lightJobs; ++i)
+        {
+            const auto start{ clock::now() };
+            submit(light, add, { 0, i, i }).wait();
+            latencies.push_back(std::chrono::duration<double, std::milli>(clock::now() - start).count());
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+        }
+        
+        std::sort(latencies.begin(), latencies.end());
+        
+        std::cout << name << ": p50 " << latencies[latencies.size() / 2] << " ms, p99 "
+                  << latencies[latencies.size() * 99 / 100] << " ms\n";
+        
+        //  Stop the load first, and let the worker finish its backlog
+        load.request_stop();
+        load.join();
+    }
+}
+
+int main()
+{
+    report("no load                     ", std::chrono::milliseconds{ 1 }, false, 0);
+    report("one queue, run to completion", std::chrono::hours{ 1 }, true, 4);
+    report("two tenants, 1 ms slices    ", std::chrono::milliseconds{ 1 }, false, 4);
+    return 0;
+}
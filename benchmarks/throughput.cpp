@@ -0,0 +1,93 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+//  Measures the number of instructions executed per second by the run-time
+//  engines, for single executions and for parallel batches.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "../ctrm/runtime.hpp"
+
+namespace
+{
+    struct benchmark
+    {
+        std::string_view name;
+        std::string_view text;
+    };
+    
+    constexpr benchmark benchmarks[]{
+            { "add", "L0 : R1- -> L1, L2\n"
+                     "L1 : R0+ -> L0\n"
+                     "L2 : R2- -> L3, L4\n"
+                     "L3 : R0+ -> L2\n"
+                     "L4 : HALT" },
+            { "multiply", "L0 : R1- -> L1, L6\n"
+                          "L1 : R2- -> L2, L4\n"
+                          "L2 : R0+ -> L3\n"
+                          "L3 : R3+ -> L1\n"
+                          "L4 : R3- -> L5, L0\n"
+                          "L5 : R2+ -> L4\n"
+                          "L6 : HALT" },
+    };
+    
+    void report(std::string_view name, std::string_view mode, std::size_t steps,
+                std::chrono::steady_clock::duration time)
+    {
+        const double seconds{ std::chrono::duration<double>(time).count() };
+        std::cout << name << ' ' << mode << ": " << static_cast<double>(steps) / seconds / 1e6
+                  << " million instructions/s\n";
+    }
+}
+
+int main()
+{
+    constexpr std::size_t rows{ 4096 };
+    
+    for (const auto& b : benchmarks)
+    {
+        const ctrm::image p{ ctrm::load(b.text) };
+        const std::size_t stride{ p.registerCount };
+        std::vector<std::uint64_t> values(rows * stride);
+        
+        const auto reset{ [&] {
+            for (std::size_t row{ 0 }; row < rows; ++row)
+            {
+                std::fill_n(values.begin() + static_cast<std::ptrdiff_t>(row * stride), stride, 0);
+                values[row * stride + 1] = row;
+                values[row * stride + 2] = 100;
+            }
+        } };
+        
+        reset();
+        std::size_t steps{ 0 };
+        auto start{ std::chrono::steady_clock::now() };
+        
+        for (std::size_t row{ 0 }; row < rows; ++row)
+            steps += ctrm::run<std::uint64_t>(p, std::span{ values }.subspan(row * stride, stride)).steps;
+        
+        report(b.name, "run", steps, std::chrono::steady_clock::now() - start);
+        
+        reset();
+        start = std::chrono::steady_clock::now();
+        steps = ctrm::runBatch<std::uint64_t>(p, values, stride).steps;
+        report(b.name, "runBatch", steps, std::chrono::steady_clock::now() - start);
+    }
+    
+    return 0;
+}
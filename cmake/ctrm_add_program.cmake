@@ -0,0 +1,44 @@
+# ctrm_add_program(<target> NAME <name> SOURCE <file.rm> [IMAGE <variable>])
+#
+# Compiles a register machine program with ctrmc when <target> is built.
+#
+# By default, generates the header <name>.hpp defining the program as
+# `inline constexpr ctrm::program<...> <name>` and adds its directory to the
+# include path of <target>. With IMAGE, writes the binary image <name>.ctrm
+# instead, for loading with ctrm::loadBinary() or ctrm_load_binary(), and
+# stores its path in <variable>.
+function(ctrm_add_program target)
+    cmake_parse_arguments(PARSE_ARGV 1 ARG "" "NAME;SOURCE;IMAGE" "")
+    
+    if (NOT ARG_NAME OR NOT ARG_SOURCE)
+        message(FATAL_ERROR "ctrm_add_program: NAME and SOURCE are required")
+    endif ()
+    
+    get_filename_component(source ${ARG_SOURCE} ABSOLUTE)
+    set(directory ${CMAKE_CURRENT_BINARY_DIR}/ctrm_programs/${target})
+    
+    if (ARG_IMAGE)
+        set(output ${directory}/${ARG_NAME}.ctrm)
+        set(arguments -o ${output} ${source})
+    else ()
+        set(output ${directory}/${ARG_NAME}.hpp)
+        set(arguments --header ${ARG_NAME} -o ${output} ${source})
+    endif ()
+    
+    add_custom_command(
+            OUTPUT ${output}
+            COMMAND ${CMAKE_COMMAND} -E make_directory ${directory}
+            COMMAND ctrm::ctrmc ${arguments}
+            DEPENDS ${source} ctrm::ctrmc
+            COMMENT "Compiling register machine program ${ARG_SOURCE}"
+            VERBATIM)
+    
+    if (ARG_IMAGE)
+        add_custom_target(${target}_${ARG_NAME}_image DEPENDS ${output})
+        add_dependencies(${target} ${target}_${ARG_NAME}_image)
+        set(${ARG_IMAGE} ${output} PARENT_SCOPE)
+    else ()
+        target_sources(${target} PRIVATE ${output})
+        target_include_directories(${target} PRIVATE ${directory})
+    endif ()
+endfunction()
@@ -0,0 +1,55 @@
+# ctrm_add_table(<target> NAME <name> HEADER <header> PROGRAM <program>
+#                TYPE <type> SIZE <size> [SHARDS <shards>] [INPUTS <inputs>])
+#
+# Builds a table of the results of a program at compile time, in shards
+# which are compiled in parallel (see ctrm/tabulate.hpp).
+#
+# <header> is included by every shard and defines <program>, a constexpr
+# ctrm::program, and <inputs> if given, a constexpr callable setting the
+# registers for an index (by default, the index is put in R1). The table
+# holds <size> entries of type <type>, and is split into <shards> segments
+# (by default, one for each processor), each compiled into <target> as a
+# separate translation unit. Generates the header <name>.hpp declaring
+# `std::span<const <type>, <size>> <name>()`, and adds its directory to the
+# include path of <target>, which must be an executable or shared library.
+function(ctrm_add_table target)
+    cmake_parse_arguments(PARSE_ARGV 1 ARG "" "NAME;HEADER;PROGRAM;TYPE;SIZE;SHARDS;INPUTS" "")
+    
+    if (NOT ARG_NAME OR NOT ARG_HEADER OR NOT ARG_PROGRAM OR NOT ARG_TYPE OR NOT ARG_SIZE)
+        message(FATAL_ERROR "ctrm_add_table: NAME, HEADER, PROGRAM, TYPE and SIZE are required")
+    endif ()
+    
+    if (NOT ARG_SHARDS)
+        cmake_host_system_information(RESULT ARG_SHARDS QUERY NUMBER_OF_LOGICAL_CORES)
+    endif ()
+    
+    if (ARG_INPUTS)
+        set(inputs ", ${ARG_INPUTS}")
+    endif ()
+    
+    set(directory ${CMAKE_CURRENT_BINARY_DIR}/ctrm_tables/${target})
+    math(EXPR count "(${ARG_SIZE} + ${ARG_SHARDS} - 1) / ${ARG_SHARDS}")
+    
+    file(CONFIGURE OUTPUT ${directory}/${ARG_NAME}.hpp CONTENT
+            "// Generated by ctrm_add_table(). Do not edit.\n#pragma once\n\n#include <ctrm/tabulate.hpp>\n\nCTRM_TABLE(${ARG_NAME}, ${ARG_TYPE}, ${ARG_SIZE})\n")
+    
+    # The shards are added in order, so that the segments are linked in order and
+    # name() does not need to copy them
+    foreach (first RANGE 0 ${ARG_SIZE} ${count})
+        math(EXPR remaining "${ARG_SIZE} - ${first}")
+        
+        if (remaining EQUAL 0)
+            break ()
+        elseif (remaining LESS count)
+            set(count ${remaining})
+        endif ()
+        
+        set(shard ${directory}/${ARG_NAME}_${first}.cpp)
+        file(CONFIGURE OUTPUT ${shard} CONTENT
+                "// Generated by ctrm_add_table(). Do not edit.\n#include <ctrm/tabulate.hpp>\n\n#include \"${ARG_HEADER}\"\n\nCTRM_TABLE_SEGMENT(${ARG_NAME}, ${ARG_PROGRAM}, ${ARG_TYPE}, ${first}, ${count}${inputs})\n")
+        target_sources(${target} PRIVATE ${shard})
+    endforeach ()
+    
+    target_include_directories(${target} PRIVATE ${directory})
+    target_link_libraries(${target} PRIVATE ctrm::ctrm)
+endfunction()
@@ -15,12 +15,23 @@
 #define COMPILE_TIME_REGISTER_MACHINE_HPP
 
 #include <array>
+#include <algorithm>
 #include <concepts>
+#include <cstdint>
 #include <limits>
+#include <span>
+#include <stdexcept>
 #include <string_view>
 #include <utility>
+#include <vector>
 
-namespace ctrm
+//  Expands to export when this header is included by the ctrm module
+//  interface (ctrm.cppm), and to nothing otherwise.
+#ifndef CTRM_EXPORT
+#define CTRM_EXPORT
+#endif
+
+CTRM_EXPORT namespace ctrm
 {
     namespace impl
     {
@@ -77,78 +88,1057 @@ namespace ctrm
         };
     }
     
-    template<std::size_t maxRegisters, std::size_t instrCount>
-    struct program
+    //  Describes where a register machine stopped after being executed for
+    //  a bounded number of steps. A program that jumps to a line outside of
+    //  the program is considered to have halted.
+    struct status
     {
-        inline static constexpr std::size_t instructionCount{ instrCount };
-        const std::array<impl::instruction, instrCount> instructions;
+        std::size_t location;
+        std::size_t steps;
+        bool halted;
+    };
+    
+    namespace impl
+    {
+        //  Longest cycle of instructions which is recognised as a loop that
+        //  can be executed in a single step.
+        inline constexpr std::size_t maxCycleLength{ 16 };
         
-        [[maybe_unused]]
-        explicit constexpr program(std::array<impl::instruction, instrCount> ins) :
-                instructions{ std::move(ins) }
+        //  Properties of a line found by analysing the instruction graph.
+        //
+        //  A guarded cycle is the cycle found by following the first jump
+        //  of every instruction from a line until the line is reached again,
+        //  in which no register is decremented twice, and no decremented
+        //  register is incremented. Every decrement in such a cycle succeeds
+        //  until its register reaches zero, so the number of iterations the
+        //  loop makes, and the decrement through which it leaves, follow from
+        //  the register values on entry. This covers moving or adding one
+        //  register to others (one decrement) and decrementing registers in
+        //  lock-step, i.e. subtraction, minimum and comparison.
+        //
+        //  Headers are lines which are the target of a jump backwards, so
+        //  every loop contains at least one. Loops which are not guarded
+        //  cycles, such as the outer loops of multiplication and division,
+        //  are accelerated from their headers at run-time (see recorder).
+        struct annotation
         {
+            std::size_t cycleLength{ 0 };
+            bool header{ false };
+        };
+        
+        constexpr void annotate(std::span<const instruction> instructions, std::span<annotation> annotations)
+        {
+            for (std::size_t line{ 0 }; line < instructions.size(); ++line)
+            {
+                annotations[line] = {};
+                
+                const auto& ins{ instructions[line] };
+                
+                if (ins.type != HALT && ins.location1 <= line)
+                    annotations[ins.location1].header = true;
+                
+                if (ins.type == DECR && ins.location2 <= line)
+                    annotations[ins.location2].header = true;
+            }
+            
+            for (std::size_t line{ 0 }; line < instructions.size(); ++line)
+            {
+                std::array<std::size_t, maxCycleLength> cycle{};
+                std::size_t length{ 0 };
+                std::size_t loc{ line };
+                
+                do
+                {
+                    if (loc >= instructions.size() || instructions[loc].type == HALT || length == maxCycleLength)
+                    {
+                        length = 0;
+                        break;
+                    }
+                    
+                    cycle[length++] = loc;
+                    loc = instructions[loc].location1;
+                }
+                while (loc != line);
+                
+                bool guarded{ false };
+                
+                for (std::size_t i{ 0 }; i < length; ++i)
+                {
+                    const auto& decrement{ instructions[cycle[i]] };
+                    
+                    if (decrement.type != DECR)
+                        continue;
+                    
+                    guarded = true;
+                    
+                    for (std::size_t j{ 0 }; j < length; ++j)
+                        if (j != i && instructions[cycle[j]].currentRegister == decrement.currentRegister)
+                            guarded = false;
+                    
+                    if (!guarded)
+                        break;
+                }
+                
+                if (guarded)
+                    annotations[line].cycleLength = length;
+            }
         }
         
-        [[maybe_unused]]
-        explicit constexpr program(const program<maxRegisters, instrCount>&) = default;
+        template<std::size_t instrCount>
+        constexpr std::array<annotation, instrCount> annotate(const std::array<instruction, instrCount>& instructions)
+        {
+            std::array<annotation, instrCount> annotations{};
+            annotate(instructions, annotations);
+            return annotations;
+        }
         
-        //  Executes a register machine program with an initial configuration
-        //  with the function arguments specifying the initial value of the
-        //  first N registers and any additional registers being initialised
-        //  to zero. The type template argument specifies the data type to be
-        //  used for the registers. Returns the value in the first register.
-        template<std::unsigned_integral IntType = std::size_t, typename... Args>
-        requires ((sizeof...(Args) <= maxRegisters) && ... && std::convertible_to<Args, IntType>)
-        [[maybe_unused]] [[nodiscard]]
-        consteval IntType exec(Args... args) const
+        //  Observations of a loop made while it is being executed from its
+        //  header, used to skip iterations of loops which are not guarded
+        //  cycles.
+        //
+        //  Each iteration is recorded as a path (the lines executed and the
+        //  way each branch went, with guarded cycles as single steps), the
+        //  values of the registers it uses at its start and end, and every
+        //  value on which a branch depended or which was incremented. Along a
+        //  fixed path every value is an affine function of the registers at
+        //  the start of the iteration, so if two consecutive iterations take
+        //  the same path and change the registers by the same amounts, the
+        //  registers and every recorded value change by those amounts in each
+        //  following iteration. The path is then repeated for as long as the
+        //  condition of every branch still holds when extrapolated, so those
+        //  iterations can be applied at once.
+        template<std::unsigned_integral IntType>
+        struct recorder
         {
-            std::array<IntType, maxRegisters> values{ static_cast<IntType>(args)... };
+            //  Conditions on recorded values which must hold for an iteration
+            //  to take the same path. Comparisons use two consecutive values.
+            enum condition : unsigned char
+            {
+                POSITIVE,
+                ZERO,
+                GREATER,
+                GREATER_EQUAL,
+                SECOND_OPERAND,
+                NOT_OVERFLOWING,
+            };
+            
+            static constexpr std::size_t maxPath{ 32 };
+            static constexpr std::size_t maxRegisters{ 16 };
+            static constexpr std::size_t maxValues{ 64 };
+            static constexpr std::size_t maxAttempts{ 4 };
+            
+            //  Recorded values must stay below this, so that the difference
+            //  between any two of them can be computed without overflow.
+            static constexpr std::uint64_t limit{ std::uint64_t{ 1 } << 62 };
             
-            bool halt{ false };
-            std::size_t loc{ 0 };
+            //  Left uninitialised, as recording is rare but a recorder is
+            //  created for every execution.
+            struct iteration
+            {
+                std::size_t pathLength;
+                std::size_t registerCount;
+                std::size_t valueCount;
+                std::size_t steps;
+                std::array<std::size_t, maxPath> path;
+                std::array<std::size_t, maxRegisters> registers;
+                std::array<std::uint64_t, maxRegisters> start;
+                std::array<std::uint64_t, maxRegisters> end;
+                std::array<std::uint64_t, maxValues> values;
+                std::array<condition, maxValues> conditions;
+            };
+            
+            std::array<iteration, 2> iterations;
+            std::size_t current{ 0 };
+            std::size_t completed{ 0 };
+            std::size_t header{ 0 };
+            std::size_t failures{ 0 };
+            std::size_t skip{ 0 };
+            bool recording{ false };
+            
+            //  Starts recording an iteration from the header at line, which
+            //  begins a new recording unless the loop is already recorded.
+            constexpr void begin(std::size_t line, std::size_t steps)
+            {
+                if (!recording)
+                {
+                    header = line;
+                    completed = 0;
+                    recording = true;
+                }
+                
+                iterations[current].pathLength = 0;
+                iterations[current].registerCount = 0;
+                iterations[current].valueCount = 0;
+                iterations[current].steps = steps;
+            }
+            
+            //  Stops recording, and ignores the next few headers if recording
+            //  keeps failing so that loops which cannot be accelerated are
+            //  not slowed down.
+            constexpr void abandon()
+            {
+                recording = false;
+                skip = (std::size_t{ 1 } << std::min<std::size_t>(failures, 16)) - 1;
+                ++failures;
+            }
+            
+            [[nodiscard]]
+            constexpr bool visited(std::size_t line) const
+            {
+                const auto& it{ iterations[current] };
+                
+                for (std::size_t i{ 0 }; i < it.pathLength; ++i)
+                    if (it.path[i] / 64 == line)
+                        return true;
+                
+                return false;
+            }
             
-            while (!halt)
+            //  Records a step: the line, and which way it went (0 or 1 for
+            //  an instruction, 2 + the leaving position for a guarded cycle).
+            constexpr void step(std::size_t line, std::size_t branch)
             {
+                auto& it{ iterations[current] };
+                
+                if (it.pathLength == maxPath)
+                    abandon();
+                else
+                    it.path[it.pathLength++] = line * 64 + branch;
+            }
+            
+            //  Notes that a register is used, remembering its value at the
+            //  start of the iteration if this is the first use.
+            constexpr void use(std::size_t reg, IntType value)
+            {
+                auto& it{ iterations[current] };
+                
+                for (std::size_t i{ 0 }; i < it.registerCount; ++i)
+                    if (it.registers[i] == reg)
+                        return;
+                
+                if (it.registerCount == maxRegisters || value >= limit)
+                {
+                    abandon();
+                    return;
+                }
+                
+                it.registers[it.registerCount] = reg;
+                it.start[it.registerCount++] = value;
+            }
+            
+            constexpr void observe(IntType value, condition c)
+            {
+                auto& it{ iterations[current] };
+                
+                if (it.valueCount == maxValues || value >= limit)
+                {
+                    abandon();
+                    return;
+                }
+                
+                it.values[it.valueCount] = value;
+                it.conditions[it.valueCount++] = c;
+            }
+            
+            //  Number of iterations, counting from the first recorded one,
+            //  for which the value at index i satisfies its condition.
+            [[nodiscard]]
+            constexpr std::uint64_t bound(std::size_t i) const
+            {
+                const auto& a{ iterations[1 - current] };
+                const auto& b{ iterations[current] };
+                
+                auto u0{ static_cast<std::int64_t>(a.values[i]) };
+                auto delta{ static_cast<std::int64_t>(b.values[i]) - u0 };
+                
+                if (a.conditions[i] == GREATER || a.conditions[i] == GREATER_EQUAL)
+                {
+                    //  Compare the difference between the operands to zero
+                    const auto v0{ static_cast<std::int64_t>(a.values[i + 1]) };
+                    delta -= static_cast<std::int64_t>(b.values[i + 1]) - v0;
+                    u0 -= v0;
+                }
+                
+                switch (a.conditions[i])
+                {
+                case POSITIVE:
+                case GREATER:
+                    if (delta < 0)
+                        return static_cast<std::uint64_t>((u0 - 1) / -delta + 1);
+                    break;
+                case GREATER_EQUAL:
+                    if (delta < 0)
+                        return static_cast<std::uint64_t>(u0 / -delta + 1);
+                    break;
+                case NOT_OVERFLOWING:
+                    if (delta > 0)
+                        return (std::numeric_limits<IntType>::max() - static_cast<std::uint64_t>(u0))
+                               / static_cast<std::uint64_t>(delta) + 1;
+                    break;
+                default:
+                    break;
+                }
+                
+                return std::numeric_limits<std::uint64_t>::max();
+            }
+            
+            //  Number of steps taken by the n iterations following the two
+            //  recorded ones, or false if this does not fit in a std::size_t.
+            //  Iteration j takes first + j * delta steps, so these take
+            //  n * first + delta * n * (n + 3) / 2 steps in total.
+            [[nodiscard]]
+            constexpr bool stepsFor(std::uint64_t n, std::size_t& result) const
+            {
+                constexpr std::uint64_t max{ std::numeric_limits<std::size_t>::max() };
+                const std::uint64_t first{ iterations[1 - current].steps };
+                const std::uint64_t second{ iterations[current].steps };
+                const std::uint64_t delta{ second >= first ? second - first : first - second };
+                
+                if (n == 0)
+                {
+                    result = 0;
+                    return true;
+                }
+                
+                const std::uint64_t half{ n % 2 == 0 ? n / 2 : (n + 3) / 2 };
+                const std::uint64_t other{ n % 2 == 0 ? n + 3 : n };
+                
+                if (n > max - 3 || first > max / n || (half != 0 && other > max / half))
+                    return false;
+                
+                const std::uint64_t triangle{ half * other };
+                const std::uint64_t base{ n * first };
+                
+                if (delta != 0 && triangle > max / delta)
+                    return false;
+                
+                if (second >= first)
+                {
+                    if (triangle * delta > max - base)
+                        return false;
+                    
+                    result = static_cast<std::size_t>(base + triangle * delta);
+                }
+                else
+                {
+                    //  Iterations get shorter, but none takes fewer than zero steps
+                    result = static_cast<std::size_t>(base - triangle * delta);
+                }
+                
+                return true;
+            }
+            
+            //  Completes an iteration on returning to the header. If the last
+            //  two iterations match, applies as many further iterations as
+            //  their conditions and fuel allow, and returns the steps taken.
+            constexpr std::size_t finish(std::span<IntType> values, std::size_t steps, std::size_t fuel)
+            {
+                auto& b{ iterations[current] };
+                b.steps = steps - b.steps;
+                
+                for (std::size_t i{ 0 }; i < b.registerCount; ++i)
+                {
+                    b.end[i] = values[b.registers[i]];
+                    
+                    if (b.end[i] >= limit)
+                    {
+                        abandon();
+                        return 0;
+                    }
+                }
+                
+                const auto& a{ iterations[1 - current] };
+                bool same{ ++completed >= 2 && a.pathLength == b.pathLength && a.registerCount == b.registerCount };
+                
+                for (std::size_t i{ 0 }; same && i < a.pathLength; ++i)
+                    same = a.path[i] == b.path[i];
+                
+                for (std::size_t i{ 0 }; same && i < a.registerCount; ++i)
+                    same = a.registers[i] == b.registers[i] && a.end[i] == b.start[i]
+                           && a.end[i] - a.start[i] == b.end[i] - b.start[i];
+                
+                std::uint64_t count{ std::numeric_limits<std::uint64_t>::max() };
+                
+                for (std::size_t i{ 0 }; same && i < a.valueCount; ++i)
+                    count = std::min(count, bound(i));
+                
+                if (!same || count <= 2)
+                {
+                    if (completed > maxAttempts)
+                    {
+                        abandon();
+                        return 0;
+                    }
+                    
+                    //  Compare the next iteration with this one
+                    current = 1 - current;
+                    begin(header, steps);
+                    return 0;
+                }
+                
+                std::uint64_t low{ 0 };
+                std::uint64_t high{ count - 2 };
+                std::size_t taken{ 0 };
+                
+                while (low < high)
+                {
+                    const std::uint64_t middle{ low + (high - low + 1) / 2 };
+                    
+                    if (stepsFor(middle, taken) && taken <= fuel - steps)
+                        low = middle;
+                    else
+                        high = middle - 1;
+                }
+                
+                static_cast<void>(stepsFor(low, taken));
+                
+                for (std::size_t i{ 0 }; i < b.registerCount; ++i)
+                {
+                    auto& value{ values[b.registers[i]] };
+                    value = static_cast<IntType>(value + low * (b.end[i] - b.start[i]));
+                }
+                
+                recording = false;
+                failures = 0;
+                return taken;
+            }
+        };
+        
+        //  Interrupt for executions which can only be stopped by fuel.
+        struct uninterruptible
+        {
+            constexpr bool operator()() const
+            {
+                return false;
+            }
+        };
+        
+        //  Number of steps between calls to the interrupt of an execution. A
+        //  loop executed in constant time may take many more steps, but only
+        //  one dispatch, so the time between calls is bounded either way.
+        inline constexpr std::size_t pollInterval{ 1024 };
+        
+        //  Executes instructions starting from the line loc on the registers
+        //  in values until the program halts or fuel instructions have been
+        //  executed. HALT instructions do not count towards the steps taken.
+        //
+        //  Loops are executed in constant time where possible (see annotation
+        //  and recorder), but the registers and the number of steps taken are
+        //  always the same as when executing one instruction at a time.
+        //
+        //  Once every pollInterval steps, interrupted() is called, and the
+        //  execution stops as if out of fuel if it returns true. The check
+        //  shares the comparison made against the fuel, so executions which
+        //  cannot be interrupted are unaffected.
+        template<std::unsigned_integral IntType, std::predicate Interrupt = uninterruptible>
+        constexpr status execute(std::span<const instruction> instructions, std::span<const annotation> annotations,
+                                 std::span<IntType> values, std::size_t loc, std::size_t fuel,
+                                 Interrupt interrupted = {})
+        {
+            constexpr bool interruptible{ !std::same_as<Interrupt, uninterruptible> };
+            std::size_t steps{ 0 };
+            std::size_t poll{ interruptible ? std::min(fuel, pollInterval) : fuel };
+            recorder<IntType> r;
+            
+            while (loc < instructions.size() && instructions[loc].type != HALT)
+            {
+                if (steps >= poll)
+                {
+                    if (steps == fuel)
+                        return { loc, steps, false };
+                    
+                    if constexpr (interruptible)
+                    {
+                        if (interrupted())
+                            return { loc, steps, false };
+                        
+                        poll = fuel - steps > pollInterval ? steps + pollInterval : fuel;
+                    }
+                }
+                
                 const auto& current{ instructions[loc] };
+                const auto& note{ annotations[loc] };
+                
+                if (note.header)
+                {
+                    if (r.recording && loc == r.header)
+                        steps += r.finish(values, steps, fuel);
+                    else if (r.recording && r.visited(loc))
+                        r.recording = false;
+                    
+                    if (!r.recording && (r.skip == 0 || r.skip-- == 0))
+                        r.begin(loc, steps);
+                    
+                    if (steps == fuel)
+                        continue;
+                }
+                
+                if (note.cycleLength != 0)
+                {
+                    //  The loop is left through the first decrement of those
+                    //  on the register holding the smallest value, and never
+                    //  if it has no decrements
+                    const std::size_t length{ note.cycleLength };
+                    bool bounded{ false };
+                    std::size_t leave{ 0 };
+                    IntType iterations{ std::numeric_limits<IntType>::max() };
+                    
+                    for (std::size_t i{ 0 }, line{ loc }; i < length; ++i, line = instructions[line].location1)
+                    {
+                        const auto& ins{ instructions[line] };
+                        
+                        if (ins.type == DECR && (!bounded || values[ins.currentRegister] < iterations))
+                        {
+                            bounded = true;
+                            iterations = values[ins.currentRegister];
+                            leave = i;
+                        }
+                    }
+                    
+                    const std::size_t remaining{ fuel - steps };
+                    const std::size_t n{ bounded ? std::min<std::size_t>(iterations, remaining / length) : remaining / length };
+                    const bool complete{ bounded && n == iterations && remaining - n * length > leave };
+                    
+                    if (n != 0 || complete)
+                    {
+                        if (r.recording && !complete)
+                            r.abandon();
+                        
+                        if (r.recording)
+                        {
+                            //  Decrements before the leaving one must hold more,
+                            //  and those after it at least as much
+                            r.step(loc, 2 + leave);
+                            
+                            for (std::size_t i{ 0 }, line{ loc }; r.recording && i < length; ++i)
+                            {
+                                const auto& ins{ instructions[line] };
+                                r.use(ins.currentRegister, values[ins.currentRegister]);
+                                
+                                if (ins.type == DECR && i != leave)
+                                {
+                                    r.observe(values[ins.currentRegister], i < leave ? r.GREATER : r.GREATER_EQUAL);
+                                    r.observe(iterations, r.SECOND_OPERAND);
+                                }
+                                
+                                line = ins.location1;
+                            }
+                        }
+                        
+                        std::size_t line{ loc };
+                        
+                        for (std::size_t i{ 0 }; i < length; ++i)
+                        {
+                            const auto& ins{ instructions[line] };
+                            const std::size_t amount{ n + (complete && i < leave ? 1 : 0) };
+                            auto& value{ values[ins.currentRegister] };
+                            
+                            if (ins.type == DECR)
+                            {
+                                value = static_cast<IntType>(value - amount);
+                            }
+                            else
+                            {
+                                if (r.recording && amount > static_cast<IntType>(std::numeric_limits<IntType>::max() - value))
+                                    r.abandon();
+                                
+                                value = static_cast<IntType>(value + amount);
+                                
+                                if (r.recording)
+                                    r.observe(value, r.NOT_OVERFLOWING);
+                            }
+                            
+                            line = ins.location1;
+                        }
+                        
+                        steps += n * length;
+                        
+                        if (complete)
+                        {
+                            steps += leave + 1;
+                            
+                            for (std::size_t i{ 0 }; i < leave; ++i)
+                                line = instructions[line].location1;
+                            
+                            loc = instructions[line].location2;
+                        }
+                        
+                        continue;
+                    }
+                }
+                
+                ++steps;
+                auto& value{ values[current.currentRegister] };
                 
-                if (current.type == impl::HALT)
+                if (r.recording)
                 {
-                    halt = true;
+                    r.use(current.currentRegister, value);
+                    
+                    if (current.type == DECR)
+                        r.observe(value, value > 0 ? r.POSITIVE : r.ZERO);
+                    else if (value == std::numeric_limits<IntType>::max())
+                        r.abandon();
                 }
-                else if (current.type == impl::INCR)
+                
+                if (r.recording)
+                    r.step(loc, current.type == DECR && value == 0 ? 1 : 0);
+                
+                if (current.type == INCR)
                 {
-                    ++values[current.currentRegister];
+                    ++value;
+                    loc = current.location1;
+                    
+                    if (r.recording)
+                        r.observe(value, r.NOT_OVERFLOWING);
+                }
+                else if (value > 0)
+                {
+                    --value;
                     loc = current.location1;
                 }
-                else if (current.type == impl::DECR)
+                else
                 {
-                    if (values[current.currentRegister] > 0)
+                    loc = current.location2;
+                }
+            }
+            
+            return { loc, steps, true };
+        }
+    }
+    
+    //  Estimated growth of the number of steps taken by a program, as the
+    //  values of its registers grow, based on how deeply its loops are
+    //  nested. An unbounded program has a loop which can never be left.
+    enum costClass
+    {
+        CONSTANT,
+        LINEAR,
+        POLYNOMIAL,
+        UNBOUNDED,
+    };
+    
+    //  Describes the structure of a program. Loops are the strongly connected
+    //  components of the lines which can be reached, and the loops nested in
+    //  each, which are found by removing the lines at which it is entered.
+    struct statistics
+    {
+        std::size_t instructions{ 0 };
+        std::size_t increments{ 0 };
+        std::size_t decrements{ 0 };
+        std::size_t halts{ 0 };
+        std::size_t registers{ 0 };
+        std::size_t reachable{ 0 };
+        std::size_t loops{ 0 };
+        std::size_t loopDepth{ 0 };
+        std::size_t largestComponent{ 0 };
+        costClass cost{ CONSTANT };
+    };
+    
+    namespace impl
+    {
+        //  Stands for every line outside of a program, to which jumps halt.
+        inline constexpr std::size_t exitLine{ std::numeric_limits<std::size_t>::max() };
+        
+        constexpr std::size_t successor(std::span<const instruction> instructions, std::size_t line, std::size_t k)
+        {
+            const auto& ins{ instructions[line] };
+            const std::size_t target{ k == 0 ? ins.location1 : ins.location2 };
+            
+            if (ins.type == HALT || (ins.type == INCR && k == 1) || target >= instructions.size())
+                return exitLine;
+            
+            return target;
+        }
+        
+        //  Marks the lines which can be reached from the first line.
+        constexpr std::vector<bool> reachable(std::span<const instruction> instructions)
+        {
+            std::vector<bool> result(instructions.size());
+            std::vector<std::size_t> stack;
+            
+            if (!instructions.empty())
+            {
+                result[0] = true;
+                stack.push_back(0);
+            }
+            
+            while (!stack.empty())
+            {
+                const std::size_t line{ stack.back() };
+                stack.pop_back();
+                
+                for (std::size_t k{ 0 }; k < 2; ++k)
+                {
+                    const std::size_t s{ successor(instructions, line, k) };
+                    
+                    if (s != exitLine && !result[s])
                     {
-                        --values[current.currentRegister];
-                        loc = current.location1;
+                        result[s] = true;
+                        stack.push_back(s);
                     }
-                    else
+                }
+            }
+            
+            return result;
+        }
+        
+        //  Numbers the strongly connected components of the lines whose group
+        //  is not exitLine, following only jumps within a group. Writes the
+        //  component of each of these lines, and returns the number of
+        //  components. Uses Tarjan's algorithm, with an explicit stack.
+        constexpr std::size_t components(std::span<const instruction> instructions, std::span<const std::size_t> group,
+                                         std::span<std::size_t> component)
+        {
+            const std::size_t n{ instructions.size() };
+            std::vector<std::size_t> index(n, exitLine);
+            std::vector<std::size_t> low(n);
+            std::vector<bool> onStack(n);
+            std::vector<std::size_t> stack;
+            std::vector<std::size_t> calls;
+            std::size_t visited{ 0 };
+            std::size_t count{ 0 };
+            
+            const auto visit{ [&](std::size_t line) {
+                index[line] = low[line] = visited++;
+                onStack[line] = true;
+                stack.push_back(line);
+                calls.push_back(line * 3);
+            } };
+            
+            for (std::size_t root{ 0 }; root < n; ++root)
+            {
+                if (group[root] == exitLine || index[root] != exitLine)
+                    continue;
+                
+                visit(root);
+                
+                while (!calls.empty())
+                {
+                    //  Each call records its line and the next jump to follow
+                    const std::size_t line{ calls.back() / 3 };
+                    const std::size_t k{ calls.back() % 3 };
+                    
+                    if (k < 2)
                     {
-                        loc = current.location2;
+                        ++calls.back();
+                        const std::size_t s{ successor(instructions, line, k) };
+                        
+                        if (s == exitLine || group[s] != group[line])
+                            continue;
+                        
+                        if (index[s] == exitLine)
+                            visit(s);
+                        else if (onStack[s])
+                            low[line] = std::min(low[line], index[s]);
+                        
+                        continue;
                     }
+                    
+                    calls.pop_back();
+                    
+                    if (!calls.empty())
+                        low[calls.back() / 3] = std::min(low[calls.back() / 3], low[line]);
+                    
+                    if (low[line] != index[line])
+                        continue;
+                    
+                    while (true)
+                    {
+                        const std::size_t member{ stack.back() };
+                        stack.pop_back();
+                        onStack[member] = false;
+                        component[member] = count;
+                        
+                        if (member == line)
+                            break;
+                    }
+                    
+                    ++count;
                 }
+            }
+            
+            return count;
+        }
+        
+        constexpr statistics measure(std::span<const instruction> instructions, std::size_t registerCount)
+        {
+            const std::size_t n{ instructions.size() };
+            const auto live{ reachable(instructions) };
+            std::vector<bool> used(registerCount);
+            statistics result;
+            result.instructions = n;
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+            {
+                const auto& ins{ instructions[line] };
                 
-                if (loc > instrCount)
+                if (ins.type == HALT)
+                    ++result.halts;
+                else if (ins.type == INCR)
+                    ++result.increments;
+                else
+                    ++result.decrements;
+                
+                if (!live[line])
+                    continue;
+                
+                ++result.reachable;
+                
+                if (ins.type != HALT && ins.currentRegister < registerCount && !used[ins.currentRegister])
                 {
-                    halt = true;
+                    used[ins.currentRegister] = true;
+                    ++result.registers;
                 }
             }
+            
+            //  Lines in no group have been removed, starting with those which
+            //  cannot be reached. Each round finds the loops within the loops
+            //  of the round before, once their entries are removed.
+            std::vector<std::size_t> group(n, exitLine);
+            std::vector<std::size_t> component(n);
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+                if (live[line])
+                    group[line] = 0;
+            
+            for (std::size_t depth{ 0 }; ; ++depth)
+            {
+                const std::size_t count{ components(instructions, group, component) };
+                std::vector<std::size_t> sizes(count);
+                std::vector<bool> cyclic(count);
+                std::vector<bool> left(count);
+                
+                for (std::size_t line{ 0 }; line < n; ++line)
+                {
+                    if (group[line] == exitLine)
+                        continue;
+                    
+                    ++sizes[component[line]];
+                    
+                    for (std::size_t k{ 0 }; k < (instructions[line].type == DECR ? 2 : 1); ++k)
+                    {
+                        const std::size_t s{ successor(instructions, line, k) };
+                        
+                        if (s == line)
+                            cyclic[component[line]] = true;
+                        
+                        if (s == exitLine || group[s] == exitLine || component[s] != component[line])
+                            left[component[line]] = true;
+                    }
+                }
+                
+                std::vector<std::size_t> next(n, exitLine);
+                bool nested{ false };
+                
+                for (std::size_t c{ 0 }; c < count; ++c)
+                {
+                    if (sizes[c] < 2 && !cyclic[c])
+                        continue;
+                    
+                    ++result.loops;
+                    nested = true;
+                    
+                    if (depth == 0)
+                    {
+                        result.largestComponent = std::max(result.largestComponent, sizes[c]);
+                        
+                        if (!left[c])
+                            result.cost = UNBOUNDED;
+                    }
+                }
+                
+                if (!nested)
+                    break;
+                
+                result.loopDepth = depth + 1;
+                
+                for (std::size_t line{ 0 }; line < n; ++line)
+                    if (group[line] != exitLine && (sizes[component[line]] > 1 || cyclic[component[line]]))
+                        next[line] = component[line];
+                
+                //  Remove the lines at which each loop is entered
+                if (n != 0)
+                    next[0] = exitLine;
+                
+                for (std::size_t line{ 0 }; line < n; ++line)
+                {
+                    for (std::size_t k{ 0 }; k < 2 && live[line]; ++k)
+                    {
+                        const std::size_t s{ successor(instructions, line, k) };
+                        
+                        if (s != exitLine && (group[line] == exitLine || component[line] != component[s]))
+                            next[s] = exitLine;
+                    }
+                }
+                
+                group = std::move(next);
+            }
+            
+            if (result.cost != UNBOUNDED)
+                result.cost = result.loopDepth == 0 ? CONSTANT : result.loopDepth == 1 ? LINEAR : POLYNOMIAL;
+            
+            return result;
+        }
+    }
+    
+    template<std::size_t maxRegisters, std::size_t instrCount>
+    struct program
+    {
+        inline static constexpr std::size_t instructionCount{ instrCount };
+        const std::array<impl::instruction, instrCount> instructions;
+        const std::array<impl::annotation, instrCount> annotations;
+        
+        [[maybe_unused]]
+        explicit constexpr program(std::array<impl::instruction, instrCount> ins) :
+                instructions{ std::move(ins) },
+                annotations{ impl::annotate(instructions) }
+        {
+        }
+        
+        [[maybe_unused]]
+        constexpr program(const program<maxRegisters, instrCount>&) = default;
+        
+        //  Executes a register machine program with an initial configuration
+        //  with the function arguments specifying the initial value of the
+        //  first N registers and any additional registers being initialised
+        //  to zero. The type template argument specifies the data type to be
+        //  used for the registers. Returns the value in the first register.
+        template<std::unsigned_integral IntType = std::size_t, typename... Args>
+        requires ((sizeof...(Args) <= maxRegisters) && ... && std::convertible_to<Args, IntType>)
+        [[maybe_unused]] [[nodiscard]]
+        consteval IntType exec(Args... args) const
+        {
+            std::array<IntType, maxRegisters> values{ static_cast<IntType>(args)... };
+            impl::execute<IntType>(instructions, annotations, values, 0, std::numeric_limits<std::size_t>::max());
             return values[0];
         }
+        
+        //  Describes the structure of the program (see statistics), so that
+        //  programs can be checked at compile time, e.g. with
+        //  static_assert(p.stats().cost <= ctrm::LINEAR).
+        [[maybe_unused]] [[nodiscard]]
+        constexpr statistics stats() const
+        {
+            return impl::measure(instructions, maxRegisters);
+        }
     };
     
-    //  Non constant expression function which is called by compile-time
-    //  functions to generate compile errors when syntax errors are found
-    //  in a register machine programs.
+    namespace impl
+    {
+        template<std::unsigned_integral IntType, auto p, IntType... args>
+        inline constexpr IntType result{ p.template exec<IntType>(args...) };
+    }
+    
+    //  The result of p.exec<IntType>(args...). Each distinct result is only
+    //  computed once in a translation unit, however many times it is used,
+    //  as the compiler reuses the instantiations of a variable template. The
+    //  arguments are converted to IntType first, so that e.g. result_v<p, 1>
+    //  and result_v<p, 1u> share an instantiation, and programs are compared
+    //  by value, so copies of a program share them too.
+    template<std::unsigned_integral IntType, auto p, auto... args>
+    requires (std::convertible_to<decltype(args), IntType> && ...)
+    inline constexpr IntType resultAs_v{ impl::result<IntType, p, static_cast<IntType>(args)...> };
+    
+    template<auto p, auto... args>
+    requires (std::convertible_to<decltype(args), std::size_t> && ...)
+    inline constexpr std::size_t result_v{ impl::result<std::size_t, p, static_cast<std::size_t>(args)...> };
+    
+    //  The registers and position of a program executed at compile time in
+    //  chunks (see execChunked), along with the number of chunks used.
+    template<std::unsigned_integral IntType, std::size_t maxRegisters>
+    struct chunkedStatus
+    {
+        std::array<IntType, maxRegisters> values;
+        std::size_t location;
+        std::size_t steps;
+        std::size_t chunks;
+        bool halted;
+    };
+    
+    namespace impl
+    {
+        template<std::unsigned_integral IntType, std::size_t maxRegisters, std::size_t instrCount, typename... Args>
+        requires ((sizeof...(Args) <= maxRegisters) && ... && std::convertible_to<Args, IntType>)
+        consteval chunkedStatus<IntType, maxRegisters> startChunked(const program<maxRegisters, instrCount>&,
+                                                                    Args... args)
+        {
+            return { { static_cast<IntType>(args)... }, 0, 0, 0, false };
+        }
+        
+        template<std::unsigned_integral IntType, std::size_t maxRegisters, std::size_t instrCount>
+        consteval chunkedStatus<IntType, maxRegisters> advance(const program<maxRegisters, instrCount>& p,
+                                                               chunkedStatus<IntType, maxRegisters> s,
+                                                               std::size_t fuel)
+        {
+            const status next{ execute<IntType>(p.instructions, p.annotations, s.values, s.location, fuel) };
+            return { s.values, next.location, s.steps + next.steps, s.chunks + 1, next.halted };
+        }
+        
+        //  Executes up to 2^depth chunks from s. Each chunk is executed in
+        //  the initialiser of its own static member, which is a separate
+        //  constant evaluation with its own limits, and the state is passed
+        //  on as a template argument.
+        template<const auto& p, std::size_t chunkSteps, auto s, std::size_t depth, bool = s.halted>
+        struct chunks
+        {
+            static constexpr auto first{ chunks<p, chunkSteps, s, depth - 1>::value };
+            static constexpr auto value{ chunks<p, chunkSteps, first, depth - 1>::value };
+        };
+        
+        template<const auto& p, std::size_t chunkSteps, auto s>
+        struct chunks<p, chunkSteps, s, 0, false>
+        {
+            static constexpr auto value{ advance(p, s, chunkSteps) };
+        };
+        
+        template<const auto& p, std::size_t chunkSteps, auto s, std::size_t depth>
+        struct chunks<p, chunkSteps, s, depth, true>
+        {
+            static constexpr auto value{ s };
+        };
+        
+        //  Executes 1, 2, 4, ... chunks until the program halts, so that the
+        //  templates are only nested twice as deeply as the logarithm of the
+        //  number of chunks.
+        template<const auto& p, std::size_t chunkSteps, auto s, std::size_t depth = 0, bool = s.halted>
+        struct chunksUntilHalted
+        {
+            static constexpr auto value{
+                    chunksUntilHalted<p, chunkSteps, chunks<p, chunkSteps, s, depth>::value, depth + 1>::value };
+        };
+        
+        template<const auto& p, std::size_t chunkSteps, auto s, std::size_t depth>
+        struct chunksUntilHalted<p, chunkSteps, s, depth, true>
+        {
+            static constexpr auto value{ s };
+        };
+    }
+    
+    //  Executes a program at compile time as program.exec() does, but in
+    //  chunks of up to chunkSteps steps, each of which is a separate constant
+    //  evaluation. The compiler limits the operations of every evaluation
+    //  (e.g. -fconstexpr-ops-limit and -fconstexpr-loop-limit in GCC, and
+    //  -fconstexpr-steps in Clang), so this lets programs run for longer than
+    //  a single call to exec() can, without raising the limits. The program
+    //  must be a constexpr variable with static storage duration, e.g.
+    //
+    //      static_assert(ctrm::execChunked<p, 100'000, std::uint64_t, 3, 4>.values[0] == 12);
+    //
+    //  The result also holds the number of steps and chunks used. Programs
+    //  which do not halt fail to compile once the templates nest too deeply.
+    template<const auto& p, std::size_t chunkSteps, std::unsigned_integral IntType = std::size_t, auto... args>
+    requires (chunkSteps != 0)
+    inline constexpr auto execChunked{
+            impl::chunksUntilHalted<p, chunkSteps, impl::startChunked<IntType>(p, args...)>::value };
+    
+    //  Called by the parser when syntax errors are found in a register
+    //  machine program. Throwing is not allowed in a constant expression,
+    //  so this generates a compile error when parsing at compile time, and
+    //  throws std::invalid_argument when parsing at run-time.
     template<typename T>
-    void error(T)
+    constexpr void error(T message)
     {
-        static_assert(true, "Error");
+        throw std::invalid_argument(message);
     }
     
     template<std::size_t instrCount>
@@ -269,17 +1259,18 @@ namespace ctrm
         {
         }
         
-        template<std::size_t maxRegisters>
-        [[nodiscard]]
-        consteval program<maxRegisters, instrCount> parse() const
+        //  Parses at most limit statements, passing the line number and the
+        //  instruction of each statement to emit. Shared by parse() and the
+        //  run-time loader, which does not know the number of instructions
+        //  in advance.
+        template<typename Emit>
+        constexpr void parseStatements(std::size_t limit, Emit&& emit) const
         {
-            std::array<impl::instruction, instrCount> instr;
-            
             std::size_t current{ 0 };
             
             skipLinesAndSpaces(current);
             
-            for (std::size_t i{ 0 }; i < instrCount && !eof(current); ++i)
+            for (std::size_t i{ 0 }; i < limit && !eof(current); ++i)
             {
                 if (isChar(current, 'L'))
                 {
@@ -301,6 +1292,9 @@ namespace ctrm
                     
                     skipSpaces(current);
                     
+                    if (eof(current))
+                        error("Error: encountered unexpected end of file");
+                    
                     switch (input[current])
                     {
                     case '+':
@@ -325,7 +1319,7 @@ namespace ctrm
                     if (incrementInstruction)
                     {
                         parseEOL(current);
-                        instr[i] = impl::instruction{ registerLocation, loc1 };
+                        emit(i, impl::instruction{ registerLocation, loc1 });
                     }
                     else
                     {
@@ -337,17 +1331,17 @@ namespace ctrm
                         skipSpaces(current);
                         std::size_t loc2{ parseLineNumber(current) };
                         parseEOL(current);
-                        instr[i] = impl::instruction{ registerLocation, loc1, loc2 };
+                        emit(i, impl::instruction{ registerLocation, loc1, loc2 });
                     }
                 }
                 else if (matchStr(current, "HALT"))
                 {
                     parseEOL(current);
-                    instr[i] = impl::instruction{};
+                    emit(i, impl::instruction{});
                 }
                 else if (matchChar(current, ';', '\n', '\0'))
                 {
-                    instr[i] = impl::instruction{};
+                    emit(i, impl::instruction{});
                 }
                 else
                 {
@@ -356,6 +1350,20 @@ namespace ctrm
                 
                 skipLinesAndSpaces(current);
             }
+        }
+        
+        template<std::size_t maxRegisters>
+        [[nodiscard]]
+        consteval program<maxRegisters, instrCount> parse() const
+        {
+            std::array<impl::instruction, instrCount> instr;
+            
+            parseStatements(instrCount, [&](std::size_t i, const impl::instruction& ins) {
+                if (ins.type != impl::HALT && ins.currentRegister >= maxRegisters)
+                    error("Program Error: register used by program exceeds the number of registers");
+                
+                instr[i] = ins;
+            });
             
             return program<maxRegisters, instrCount>(instr);
         }
@@ -0,0 +1,332 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_ARENA_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_ARENA_HPP
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "runtime.hpp"
+
+//  Memory resources for programs loaded at run-time and the registers they
+//  execute on. An arena carves allocations out of large slabs and frees
+//  them all at once, so that loading many programs, or executing one for
+//  each request, makes few calls to the allocator.
+namespace ctrm
+{
+    //  A monotonic memory resource: allocations are taken from the end of
+    //  the current slab, and deallocating does nothing. Slabs are kept when
+    //  the arena is rewound, so an arena which is reused, e.g. once per
+    //  request, stops allocating once it has grown large enough. Like
+    //  std::pmr::monotonic_buffer_resource, but rewinding takes constant time
+    //  and keeps the slabs. Not thread-safe.
+    class arena : public std::pmr::memory_resource
+    {
+        struct slab;
+    
+    public:
+        //  A position in an arena, to which it can be rewound.
+        struct marker
+        {
+            slab* current;
+            std::byte* cursor;
+        };
+        
+        explicit arena(std::size_t slabSize = std::size_t{ 1 } << 20,
+                       std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) :
+                slabSize{ std::max(slabSize, sizeof(slab) * 2) },
+                upstream{ upstream }
+        {
+        }
+        
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+        
+        ~arena() override
+        {
+            release();
+        }
+        
+        [[nodiscard]]
+        marker mark() const noexcept
+        {
+            return { current, cursor };
+        }
+        
+        //  Frees everything allocated since the marker was taken. Markers
+        //  taken after it can no longer be used.
+        void rewind(marker m) noexcept
+        {
+            current = m.current;
+            cursor = m.cursor;
+            end = current == nullptr ? nullptr : current->end();
+        }
+        
+        //  Frees everything allocated from the arena, keeping its slabs.
+        void reset() noexcept
+        {
+            rewind({ first, first == nullptr ? nullptr : first->begin() });
+        }
+        
+        //  Frees everything allocated from the arena, and returns its slabs
+        //  to the upstream resource.
+        void release() noexcept
+        {
+            while (first != nullptr)
+            {
+                slab* s{ std::exchange(first, first->next) };
+                upstream->deallocate(s, s->size, alignof(slab));
+            }
+            
+            rewind({ nullptr, nullptr });
+        }
+        
+        //  Bytes held in slabs, whether or not they are in use.
+        [[nodiscard]]
+        std::size_t capacity() const noexcept
+        {
+            std::size_t result{ 0 };
+            
+            for (const slab* s{ first }; s != nullptr; s = s->next)
+                result += s->size;
+            
+            return result;
+        }
+    
+    private:
+        //  Each slab starts with this header, and allocations follow it.
+        struct slab
+        {
+            slab* next;
+            std::size_t size;
+            
+            std::byte* begin() noexcept
+            {
+                return reinterpret_cast<std::byte*>(this + 1);
+            }
+            
+            std::byte* end() noexcept
+            {
+                return reinterpret_cast<std::byte*>(this) + size;
+            }
+        };
+        
+        std::size_t slabSize;
+        std::pmr::memory_resource* upstream;
+        slab* first{ nullptr };
+        slab* current{ nullptr };
+        std::byte* cursor{ nullptr };
+        std::byte* end{ nullptr };
+        
+        static std::byte* align(std::byte* p, std::size_t alignment) noexcept
+        {
+            const auto address{ reinterpret_cast<std::uintptr_t>(p) };
+            return p + ((alignment - address % alignment) % alignment);
+        }
+        
+        static bool fits(std::byte* from, std::byte* to, std::size_t bytes, std::size_t alignment) noexcept
+        {
+            const auto padding{ static_cast<std::size_t>(align(from, alignment) - from) };
+            const auto space{ static_cast<std::size_t>(to - from) };
+            return padding <= space && bytes <= space - padding;
+        }
+        
+        //  Moves to the next slab which can hold the allocation, adding one
+        //  after the current slab if there is none. Slabs passed over are
+        //  not used again until the arena is rewound.
+        void grow(std::size_t bytes, std::size_t alignment)
+        {
+            slab* s{ current == nullptr ? first : current->next };
+            
+            while (s != nullptr && !fits(s->begin(), s->end(), bytes, alignment))
+                s = s->next;
+            
+            if (s == nullptr)
+            {
+                const std::size_t size{ std::max(slabSize, sizeof(slab) + bytes + alignment) };
+                s = static_cast<slab*>(upstream->allocate(size, alignof(slab)));
+                s->size = size;
+                
+                if (current == nullptr)
+                {
+                    s->next = first;
+                    first = s;
+                }
+                else
+                {
+                    s->next = current->next;
+                    current->next = s;
+                }
+            }
+            
+            current = s;
+            cursor = s->begin();
+            end = s->end();
+        }
+        
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            if (cursor == nullptr || !fits(cursor, end, bytes, alignment))
+                grow(bytes, alignment);
+            
+            std::byte* result{ align(cursor, alignment) };
+            cursor = result + bytes;
+            return result;
+        }
+        
+        void do_deallocate(void*, std::size_t, std::size_t) override
+        {
+        }
+        
+        [[nodiscard]]
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+    
+    //  The calling thread's arena for memory which is only needed while
+    //  handling a request, such as register files.
+    [[maybe_unused]] [[nodiscard]]
+    inline arena& scratch()
+    {
+        thread_local arena a{ std::size_t{ 1 } << 16 };
+        return a;
+    }
+    
+    //  Frees what is allocated from the calling thread's scratch arena while
+    //  it exists, on destruction. Scopes can be nested.
+    class scratchScope
+    {
+    public:
+        scratchScope() :
+                start{ scratch().mark() }
+        {
+        }
+        
+        scratchScope(const scratchScope&) = delete;
+        scratchScope& operator=(const scratchScope&) = delete;
+        
+        ~scratchScope()
+        {
+            scratch().rewind(start);
+        }
+    
+    private:
+        arena::marker start;
+    };
+    
+    //  Registers for an execution, allocated from the calling thread's
+    //  scratch arena. They must not outlive the enclosing scratchScope.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]] [[nodiscard]]
+    std::pmr::vector<IntType> scratchRegisters(std::size_t count)
+    {
+        return std::pmr::vector<IntType>(count, &scratch());
+    }
+    
+    //  Images loaded at run-time, by name. The images, their annotations and
+    //  the registry's own bookkeeping are carved out of an arena, and are
+    //  only freed together when the registry is cleared or destroyed.
+    //  Programs are parsed into the calling thread's scratch arena first, so
+    //  that only their final size is kept. Loading is not thread-safe, but
+    //  the images can be executed on any number of threads.
+    class registry
+    {
+    public:
+        explicit registry(std::size_t slabSize = std::size_t{ 1 } << 22,
+                          std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) :
+                memory{ slabSize, upstream },
+                entries{ &memory }
+        {
+        }
+        
+        //  Adds a copy of an image, replacing any with the same name. The
+        //  memory used by a replaced image is only freed by clear().
+        const image& add(std::string_view name, const image& p)
+        {
+            p.check();
+            return entries.insert_or_assign(std::pmr::string{ name, &memory }, image{ p, &memory }).first->second;
+        }
+        
+        //  Loads a program in the text format (see load()).
+        const image& load(std::string_view name, std::string_view text)
+        {
+            const scratchScope scope;
+            return add(name, ctrm::load(text, &scratch()));
+        }
+        
+        //  Loads a program in the binary format (see loadBinary()).
+        const image& loadBinary(std::string_view name, std::span<const std::byte> data)
+        {
+            const scratchScope scope;
+            return add(name, ctrm::loadBinary(data, &scratch()));
+        }
+        
+        //  Returns nullptr if there is no image with the name.
+        [[nodiscard]]
+        const image* find(std::string_view name) const
+        {
+            const auto i{ entries.find(name) };
+            return i == entries.end() ? nullptr : &i->second;
+        }
+        
+        [[nodiscard]]
+        std::size_t size() const noexcept
+        {
+            return entries.size();
+        }
+        
+        //  Bytes held by the registry's arena.
+        [[nodiscard]]
+        std::size_t capacity() const noexcept
+        {
+            return memory.capacity();
+        }
+        
+        //  Removes every image, and frees the memory they used at once.
+        void clear() noexcept
+        {
+            entries = decltype(entries){ &memory };
+            memory.release();
+        }
+    
+    private:
+        //  Allows images to be found by a std::string_view
+        struct nameHash
+        {
+            using is_transparent = void;
+            
+            std::size_t operator()(std::string_view name) const noexcept
+            {
+                return std::hash<std::string_view>{}(name);
+            }
+        };
+        
+        arena memory;
+        std::pmr::unordered_map<std::pmr::string, image, nameHash, std::equal_to<>> entries;
+    };
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_ARENA_HPP
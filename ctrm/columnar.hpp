@@ -0,0 +1,304 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_COLUMNAR_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_COLUMNAR_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+#include "runtime.hpp"
+
+//  A compact format for the registers of batches, stored by column rather
+//  than by row. Most registers in a sweep hold small or slowly changing
+//  values, so each column of a block is stored either as deltas between
+//  consecutive values in variable-length integers, or packed into the
+//  fewest bits needed for its range, whichever is smaller.
+//
+//  A file starts with the magic "CTRC" and the number of columns (4 bytes),
+//  followed by any number of blocks. Each block holds its number of rows
+//  (4 bytes), then for each column an encoding (1 byte), the size of its
+//  data (4 bytes) and the data. All integers are little-endian.
+//
+//  Blocks are decoded straight into structure-of-arrays buffers, where
+//  column c of row r is at values[c * columnStride + r].
+namespace ctrm
+{
+    namespace impl
+    {
+        inline constexpr std::array<char, 4> columnarMagic{ 'C', 'T', 'R', 'C' };
+        inline constexpr std::size_t columnarHeaderSize{ 8 };
+        inline constexpr std::size_t columnHeaderSize{ 5 };
+        
+        //  The size of a column is stored in 4 bytes. A column is never
+        //  larger than when packed at 64 bits a value, so blocks of at most
+        //  this many rows always fit.
+        inline constexpr std::size_t maxBlockRows{ (std::numeric_limits<std::uint32_t>::max() - 17) / 8 };
+        
+        enum columnEncoding : std::uint8_t
+        {
+            //  Zigzag-encoded differences from the previous value (starting
+            //  from zero), each as a LEB128 variable-length integer.
+            DELTA_VARINT,
+            
+            //  The minimum value (8 bytes) and a width (1 byte), followed by
+            //  the difference of each value from the minimum in width bits,
+            //  packed into 64-bit words from the least significant bit. One
+            //  extra word follows, so that decoding can always read the word
+            //  after the one holding a value.
+            BIT_PACKED,
+        };
+        
+        inline void appendInt(std::vector<std::byte>& out, std::uint64_t value, std::size_t size)
+        {
+            out.resize(out.size() + size);
+            writeInt(out.data() + out.size() - size, value, size);
+        }
+        
+        inline std::size_t varintSize(std::uint64_t value)
+        {
+            return static_cast<std::size_t>(std::max<std::uint64_t>(std::bit_width(value), 1) + 6) / 7;
+        }
+        
+        inline std::uint64_t zigzag(std::uint64_t delta)
+        {
+            return (delta << 1) ^ (0 - (delta >> 63));
+        }
+        
+        inline std::uint64_t unzigzag(std::uint64_t value)
+        {
+            return (value >> 1) ^ (0 - (value & 1));
+        }
+        
+        inline std::size_t packedSize(std::size_t rows, std::size_t width)
+        {
+            return 9 + 8 * ((rows * width + 63) / 64 + 1);
+        }
+        
+        inline void encodeColumn(std::vector<std::byte>& out, const std::uint64_t* column, std::size_t rows)
+        {
+            std::uint64_t lowest{ std::numeric_limits<std::uint64_t>::max() };
+            std::uint64_t highest{ 0 };
+            std::size_t deltaSize{ 0 };
+            
+            for (std::size_t row{ 0 }; row < rows; ++row)
+            {
+                lowest = std::min(lowest, column[row]);
+                highest = std::max(highest, column[row]);
+                deltaSize += varintSize(zigzag(column[row] - (row == 0 ? 0 : column[row - 1])));
+            }
+            
+            const auto width{ static_cast<std::size_t>(rows == 0 ? 0 : std::bit_width(highest - lowest)) };
+            const std::size_t packed{ packedSize(rows, width) };
+            const std::size_t start{ out.size() };
+            
+            if (deltaSize < packed)
+            {
+                appendInt(out, DELTA_VARINT, 1);
+                appendInt(out, deltaSize, 4);
+                out.resize(start + columnHeaderSize + deltaSize);
+                std::byte* o{ out.data() + start + columnHeaderSize };
+                
+                for (std::size_t row{ 0 }; row < rows; ++row)
+                {
+                    std::uint64_t value{ zigzag(column[row] - (row == 0 ? 0 : column[row - 1])) };
+                    
+                    for (; value >= 0x80; value >>= 7)
+                        *o++ = static_cast<std::byte>(value | 0x80);
+                    
+                    *o++ = static_cast<std::byte>(value);
+                }
+                
+                return;
+            }
+            
+            appendInt(out, BIT_PACKED, 1);
+            appendInt(out, packed, 4);
+            appendInt(out, lowest, 8);
+            appendInt(out, width, 1);
+            
+            std::vector<std::uint64_t> words((rows * width + 63) / 64 + 1, 0);
+            
+            for (std::size_t row{ 0 }; row < rows && width != 0; ++row)
+            {
+                const std::uint64_t value{ column[row] - lowest };
+                const std::size_t bit{ row * width };
+                words[bit / 64] |= value << (bit % 64);
+                
+                if (bit % 64 + width > 64)
+                    words[bit / 64 + 1] |= value >> (64 - bit % 64);
+            }
+            
+            for (const std::uint64_t word : words)
+                appendInt(out, word, 8);
+        }
+        
+        //  Decodes one column, which the caller has checked fits in data.
+        //  Returns false if the column is malformed.
+        inline bool decodeColumn(const std::byte* data, std::size_t size, std::uint8_t encoding, std::uint64_t* column,
+                                 std::size_t rows)
+        {
+            if (encoding == DELTA_VARINT)
+            {
+                std::uint64_t value{ 0 };
+                std::size_t i{ 0 };
+                
+                for (std::size_t row{ 0 }; row < rows; ++row)
+                {
+                    std::uint64_t delta{ 0 };
+                    
+                    for (std::size_t shift{ 0 }; ; shift += 7)
+                    {
+                        if (i == size || shift > 63)
+                            return false;
+                        
+                        const auto byte{ static_cast<std::uint64_t>(data[i++]) };
+                        delta |= (byte & 0x7f) << shift;
+                        
+                        if ((byte & 0x80) == 0)
+                            break;
+                    }
+                    
+                    value += unzigzag(delta);
+                    column[row] = value;
+                }
+                
+                return i == size;
+            }
+            
+            const std::size_t width{ size < 9 ? 65 : static_cast<std::size_t>(data[8]) };
+            
+            if (encoding != BIT_PACKED || width > 64 || size != packedSize(rows, width))
+                return false;
+            
+            //  Branch-free, so that the compiler can vectorise it
+            const std::uint64_t lowest{ readInt(data, 8) };
+            const std::uint64_t mask{ width == 64 ? ~std::uint64_t{ 0 } : (std::uint64_t{ 1 } << width) - 1 };
+            const std::byte* words{ data + 9 };
+            
+            if (width == 0)
+                std::fill(column, column + rows, lowest);
+            
+            for (std::size_t row{ 0 }; row < rows && width != 0; ++row)
+            {
+                const std::size_t bit{ row * width };
+                const std::size_t shift{ bit % 64 };
+                const std::uint64_t low{ readInt(words + bit / 64 * 8, 8) };
+                const std::uint64_t high{ readInt(words + bit / 64 * 8 + 8, 8) };
+                column[row] = lowest + (((low >> shift) | (high << 1 << (63 - shift))) & mask);
+            }
+            
+            return true;
+        }
+    }
+    
+    //  Appends the header of a columnar file with the given number of
+    //  registers in each row.
+    [[maybe_unused]]
+    inline void writeColumnarHeader(std::vector<std::byte>& out, std::size_t columns)
+    {
+        for (const char c : impl::columnarMagic)
+            out.push_back(static_cast<std::byte>(c));
+        
+        impl::appendInt(out, columns, 4);
+    }
+    
+    //  Returns the number of registers in each row of a columnar file.
+    //  Throws std::invalid_argument if data does not start with a header.
+    [[maybe_unused]] [[nodiscard]]
+    inline std::size_t readColumnarHeader(std::span<const std::byte> data)
+    {
+        if (data.size() < impl::columnarHeaderSize
+            || !std::equal(impl::columnarMagic.begin(), impl::columnarMagic.end(), data.begin(),
+                           [](char c, std::byte b) { return static_cast<std::byte>(c) == b; }))
+            throw std::invalid_argument("Columnar Error: missing columnar header");
+        
+        return impl::readInt(data.data() + 4, 4);
+    }
+    
+    //  Appends a block of rows to a columnar file, taking column c of row r
+    //  from values[c * columnStride + r]. Throws std::length_error if the
+    //  block does not fit in values, or has more than impl::maxBlockRows
+    //  rows.
+    [[maybe_unused]]
+    inline void encodeBlock(std::vector<std::byte>& out, std::span<const std::uint64_t> values, std::size_t columns,
+                            std::size_t rows, std::size_t columnStride)
+    {
+        if (rows > impl::maxBlockRows)
+            throw std::length_error("block has too many rows");
+        
+        if (rows > columnStride || (columns != 0 && values.size() < (columns - 1) * columnStride + rows))
+            throw std::length_error("block does not fit in the buffer");
+        
+        impl::appendInt(out, rows, 4);
+        
+        for (std::size_t c{ 0 }; c < columns; ++c)
+            impl::encodeColumn(out, values.data() + c * columnStride, rows);
+    }
+    
+    //  Returns the number of rows in the block at the start of data, or zero
+    //  if there are no more blocks.
+    [[maybe_unused]] [[nodiscard]]
+    inline std::size_t blockRows(std::span<const std::byte> data)
+    {
+        return data.size() < 4 ? 0 : impl::readInt(data.data(), 4);
+    }
+    
+    //  Decodes the block at the start of data into values, writing column c
+    //  of row r to values[c * columnStride + r]. Returns the size of the
+    //  block in bytes. Throws std::length_error if the block does not fit in
+    //  values, and std::invalid_argument if the block is malformed.
+    [[maybe_unused]]
+    inline std::size_t decodeBlock(std::span<const std::byte> data, std::span<std::uint64_t> values,
+                                   std::size_t columns, std::size_t columnStride)
+    {
+        const std::size_t rows{ blockRows(data) };
+        
+        if (data.size() < 4)
+            throw std::invalid_argument("Columnar Error: block is truncated");
+        
+        if (rows > columnStride || (columns != 0 && values.size() < (columns - 1) * columnStride + rows))
+            throw std::length_error("block does not fit in the buffer");
+        
+        std::size_t offset{ 4 };
+        
+        for (std::size_t c{ 0 }; c < columns; ++c)
+        {
+            if (data.size() - offset < impl::columnHeaderSize)
+                throw std::invalid_argument("Columnar Error: block is truncated");
+            
+            const auto encoding{ static_cast<std::uint8_t>(data[offset]) };
+            const std::size_t size{ impl::readInt(data.data() + offset + 1, 4) };
+            offset += impl::columnHeaderSize;
+            
+            if (data.size() - offset < size)
+                throw std::invalid_argument("Columnar Error: block is truncated");
+            
+            if (!impl::decodeColumn(data.data() + offset, size, encoding, values.data() + c * columnStride, rows))
+                throw std::invalid_argument("Columnar Error: column is corrupt");
+            
+            offset += size;
+        }
+        
+        return offset;
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_COLUMNAR_HPP
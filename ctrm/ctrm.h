@@ -0,0 +1,105 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_C_API_H
+#define COMPILE_TIME_REGISTER_MACHINE_C_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(CTRM_BUILDING_LIBRARY)
+#define CTRM_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define CTRM_API __declspec(dllimport)
+#else
+#define CTRM_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  C interface to the run-time engines of ctrm, provided by libctrm. Programs
+ *  are referred to by opaque handles. Registers are always 64 bits wide and
+ *  are owned by the caller. Only the functions which create a handle and
+ *  ctrm_run_batch(), which starts its threads on every call, allocate memory;
+ *  a batch on a single thread runs on the calling thread and does not. A
+ *  handle may be used by several threads at once, provided that
+ *  ctrm_set_fuel() is not called at the same time. */
+typedef struct ctrm_program ctrm_program;
+
+typedef enum ctrm_result
+{
+    CTRM_OK = 0,
+    CTRM_OUT_OF_FUEL = 1,
+    CTRM_INVALID_ARGUMENT = -1,
+    CTRM_SYNTAX_ERROR = -2,
+    CTRM_INVALID_IMAGE = -3,
+    CTRM_OUT_OF_MEMORY = -4
+} ctrm_result;
+
+typedef struct ctrm_stats
+{
+    uint64_t runs;
+    uint64_t steps;
+    uint64_t out_of_fuel;
+} ctrm_stats;
+
+/*  Parses a program in the text format. On success, *program receives a
+ *  handle which must be released with ctrm_free(). */
+CTRM_API ctrm_result ctrm_load_text(const char* text, size_t length, ctrm_program** program);
+
+/*  Loads a program from the binary image format written by
+ *  ctrm_save_binary(). */
+CTRM_API ctrm_result ctrm_load_binary(const void* data, size_t size, ctrm_program** program);
+
+/*  Writes the binary image of a program to buffer, returning its size in
+ *  bytes. Nothing is written if size is smaller than the returned value.
+ *  Returns 0 for a null program. */
+CTRM_API size_t ctrm_save_binary(const ctrm_program* program, void* buffer, size_t size);
+
+CTRM_API void ctrm_free(ctrm_program* program);
+
+/*  Number of registers each execution of the program needs, or 0 for a
+ *  null program. */
+CTRM_API size_t ctrm_register_count(const ctrm_program* program);
+
+/*  Number of lines in the program, or 0 for a null program. */
+CTRM_API size_t ctrm_instruction_count(const ctrm_program* program);
+
+/*  Limits every subsequent execution of the program to fuel instructions.
+ *  A fuel of 0 removes the limit, which is the default. Does nothing for a
+ *  null program. */
+CTRM_API void ctrm_set_fuel(ctrm_program* program, uint64_t fuel);
+
+/*  Executes a program once on count registers, which must be at least
+ *  ctrm_register_count(). Returns CTRM_OUT_OF_FUEL if the program did not
+ *  halt within its fuel. stats may be NULL. */
+CTRM_API ctrm_result ctrm_run(const ctrm_program* program, uint64_t* registers, size_t count, ctrm_stats* stats);
+
+/*  Executes a program once for each of rows rows of stride registers, on
+ *  threads threads (0 for one per hardware thread). Returns
+ *  CTRM_OUT_OF_FUEL if any execution did not halt within its fuel. */
+CTRM_API ctrm_result ctrm_run_batch(const ctrm_program* program, uint64_t* registers, size_t stride, size_t rows,
+                                    unsigned threads, ctrm_stats* stats);
+
+/*  Describes the most recent error on the calling thread. Long messages are
+ *  truncated to fit a fixed buffer. */
+CTRM_API const char* ctrm_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*  COMPILE_TIME_REGISTER_MACHINE_C_API_H */
@@ -0,0 +1,340 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_GRAPH_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_GRAPH_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <map>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "optimise.hpp"
+#include "superinstructions.hpp"
+
+//  Writes the control-flow graph of an image in the Graphviz DOT format, to
+//  be rendered with e.g. "dot -Tsvg". Given a profile (see profile()), nodes
+//  are shaded by the number of steps executed in them and edges are labelled
+//  with the number of times they were followed.
+namespace ctrm
+{
+    struct dotOptions
+    {
+        //  Draws each loop which moves one register onto others as a single
+        //  node.
+        bool collapseTransfers{ true };
+        
+        //  Draws each strongly connected component, and each run of lines
+        //  with a single way in and out, as a single node. This keeps the
+        //  graphs of large programs readable.
+        bool collapseComponents{ false };
+    };
+    
+    namespace impl
+    {
+        struct dotEdge
+        {
+            std::size_t count{ 0 };
+            bool known{ true };
+            bool zero{ true };
+        };
+        
+        //  Shades from white to red by a fraction of the hottest node or
+        //  edge, on a logarithmic scale.
+        inline double heat(std::size_t count, std::size_t hottest)
+        {
+            return hottest == 0 ? 0.0 : std::log1p(static_cast<double>(count)) / std::log1p(static_cast<double>(hottest));
+        }
+        
+        inline std::string lineLabel(const instruction& ins, std::size_t line)
+        {
+            std::string result{ "L" + std::to_string(line) + ": " };
+            
+            if (ins.type == HALT)
+                return result + "HALT";
+            
+            return result + "R" + std::to_string(ins.currentRegister) + (ins.type == INCR ? "+" : "-");
+        }
+        
+        //  Groups the lines of an image into the nodes to draw. Returns the
+        //  node of each line, numbered by one of its lines, and sets the
+        //  label of each node which is not a single line.
+        inline std::vector<std::size_t> dotNodes(const image& p, const dotOptions& options,
+                                                 std::vector<std::string>& labels)
+        {
+            const std::size_t n{ p.instructions.size() };
+            std::vector<std::size_t> node(n);
+            std::vector<std::size_t> entries(n, 0);
+            labels.assign(n, {});
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+            {
+                node[line] = line;
+                
+                for (std::size_t k{ 0 }; k < 2; ++k)
+                    if (const std::size_t s{ successor(p.instructions, line, k) }; s != exitLine)
+                        ++entries[s];
+            }
+            
+            if (n != 0)
+                ++entries[0];
+            
+            transfer t;
+            
+            for (std::size_t h{ 0 }; h < n && options.collapseTransfers; ++h)
+            {
+                if (node[h] != h || !findTransfer(p.instructions, h, t))
+                    continue;
+                
+                bool enclosed{ true };
+                
+                for (std::size_t i{ 1 }; i < t.lines.size(); ++i)
+                    enclosed = enclosed && entries[t.lines[i]] == 1 && node[t.lines[i]] == t.lines[i];
+                
+                if (!enclosed)
+                    continue;
+                
+                if (t.targets.empty())
+                    labels[h] = "L" + std::to_string(h) + ": clear R" + std::to_string(t.source);
+                else
+                    labels[h] = "L" + std::to_string(h) + ": R" + std::to_string(t.source) + " to ";
+                
+                for (std::size_t i{ 0 }; i < t.targets.size(); ++i)
+                    labels[h] += (i == 0 ? "R" : ", R") + std::to_string(t.targets[i]);
+                
+                for (const std::size_t line : t.lines)
+                    node[line] = h;
+            }
+            
+            if (!options.collapseComponents)
+                return node;
+            
+            const std::vector<std::size_t> group(n, 0);
+            std::vector<std::size_t> component(n);
+            const std::size_t count{ components(p.instructions, group, component) };
+            std::vector<std::size_t> first(count, exitLine);
+            std::vector<std::size_t> sizes(count, 0);
+            std::vector<bool> loop(count, false);
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+            {
+                const std::size_t c{ component[line] };
+                first[c] = std::min(first[c], line);
+                ++sizes[c];
+                
+                for (std::size_t k{ 0 }; k < 2; ++k)
+                    loop[c] = loop[c] || successor(p.instructions, line, k) == line;
+            }
+            
+            std::vector<bool> whole(count, true);
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+            {
+                const std::size_t c{ component[line] };
+                loop[c] = loop[c] || sizes[c] > 1;
+                whole[c] = whole[c] && node[line] == node[first[c]];
+            }
+            
+            //  Keep the label of a transfer which makes up a whole loop
+            for (std::size_t c{ 0 }; c < count; ++c)
+            {
+                if (!loop[c])
+                    continue;
+                
+                if (!whole[c] || labels[node[first[c]]].empty())
+                    labels[first[c]] = "L" + std::to_string(first[c]) + ": loop of " + std::to_string(sizes[c]) + " lines";
+                else
+                    labels[first[c]] = labels[node[first[c]]];
+            }
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+                node[line] = loop[component[line]] ? first[component[line]] : line;
+            
+            //  Join each line outside of a loop to the line after it, when it
+            //  has no other way out and the next has no other way in
+            std::vector<std::size_t> ways(n, 0);
+            std::vector<std::size_t> previous(n, exitLine);
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+            {
+                const std::size_t s1{ successor(p.instructions, line, 0) };
+                const std::size_t s2{ successor(p.instructions, line, 1) };
+                
+                if (s1 != exitLine && node[s1] != node[line])
+                    ++ways[s1];
+                
+                if (s2 != exitLine && s2 != s1 && node[s2] != node[line])
+                    ++ways[s2];
+            }
+            
+            const auto single{ [&](std::size_t line) {
+                return !loop[component[line]] && p.instructions[line].type != HALT;
+            } };
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+            {
+                const std::size_t s{ successor(p.instructions, line, 0) };
+                const bool straight{ p.instructions[line].type == INCR || successor(p.instructions, line, 1) == s };
+                
+                if (single(line) && straight && s != exitLine && s != 0 && single(s) && ways[s] == 1)
+                    previous[s] = line;
+            }
+            
+            //  Number each run by its first line, shortening the paths found
+            std::vector<std::size_t> runLength(n, 0);
+            std::vector<std::size_t> last(n, 0);
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+            {
+                std::size_t start{ line };
+                
+                while (previous[start] != exitLine)
+                    start = previous[start];
+                
+                for (std::size_t l{ line }; previous[l] != exitLine;)
+                    l = std::exchange(previous[l], start);
+                
+                if (single(line))
+                    node[line] = start;
+                
+                ++runLength[node[line]];
+                last[node[line]] = std::max(last[node[line]], line);
+            }
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+                if (node[line] == line && labels[line].empty() && runLength[line] > 1)
+                    labels[line] = "L" + std::to_string(line) + " to L" + std::to_string(last[line]) + ": "
+                                   + std::to_string(runLength[line]) + " lines";
+            
+            return node;
+        }
+    }
+    
+    //  Writes the control-flow graph of an image. A profile, if given, has
+    //  the number of times each line was executed in counts, and the number
+    //  of times each decrement found its register at zero in zeros (see
+    //  profile()). Jumps taken when a register is zero are dashed.
+    [[maybe_unused]]
+    inline void toDot(std::ostream& out, const image& p, std::span<const std::size_t> counts = {},
+                      std::span<const std::size_t> zeros = {}, const dotOptions& options = {})
+    {
+        const std::size_t n{ p.instructions.size() };
+        
+        if ((!counts.empty() && counts.size() != n) || (!zeros.empty() && zeros.size() != n))
+            throw std::invalid_argument("profile does not match the image");
+        
+        std::vector<std::string> labels;
+        const auto node{ impl::dotNodes(p, options, labels) };
+        std::vector<std::size_t> steps(n, 0);
+        std::map<std::pair<std::size_t, std::size_t>, impl::dotEdge> edges;
+        bool exits{ false };
+        
+        for (std::size_t line{ 0 }; line < n; ++line)
+        {
+            const auto& ins{ p.instructions[line] };
+            const std::size_t count{ counts.empty() ? 0 : counts[line] };
+            steps[node[line]] += count;
+            
+            for (std::size_t k{ 0 }; k < (ins.type == impl::DECR ? 2 : ins.type == impl::INCR ? 1 : 0); ++k)
+            {
+                const std::size_t s{ impl::successor(p.instructions, line, k) };
+                const std::size_t target{ s == impl::exitLine ? impl::exitLine : node[s] };
+                
+                if (target == node[line])
+                    continue;
+                
+                auto& edge{ edges[{ node[line], target }] };
+                exits = exits || s == impl::exitLine;
+                edge.zero = edge.zero && k == 1;
+                
+                if (ins.type == impl::INCR)
+                    edge.known = edge.known && !counts.empty();
+                else
+                    edge.known = edge.known && !zeros.empty();
+                
+                if (edge.known)
+                    edge.count += ins.type == impl::INCR ? count : k == 0 ? count - zeros[line] : zeros[line];
+            }
+        }
+        
+        const std::size_t hottestNode{ steps.empty() ? 0 : *std::max_element(steps.begin(), steps.end()) };
+        std::size_t hottestEdge{ 0 };
+        
+        for (const auto& [key, edge] : edges)
+            hottestEdge = std::max(hottestEdge, edge.count);
+        
+        out << "digraph program {\n"
+            << "    node [shape=box, style=filled, fillcolor=white, fontname=monospace];\n";
+        
+        for (std::size_t line{ 0 }; line < n; ++line)
+        {
+            if (node[line] != line)
+                continue;
+            
+            out << "    L" << line << " [label=\""
+                << (labels[line].empty() ? impl::lineLabel(p.instructions[line], line) : labels[line]);
+            
+            if (!counts.empty())
+                out << "\\n" << steps[line] << " steps";
+            
+            out << '"';
+            
+            if (p.instructions[line].type == impl::HALT)
+                out << ", shape=oval";
+            
+            if (!counts.empty())
+            {
+                std::array<char, 32> colour{};
+                std::snprintf(colour.data(), colour.size(), "0.000 %.3f 1.000", impl::heat(steps[line], hottestNode));
+                out << ", fillcolor=\"" << colour.data() << '"';
+            }
+            
+            out << "];\n";
+        }
+        
+        if (exits)
+            out << "    exit [shape=oval];\n";
+        
+        for (const auto& [key, edge] : edges)
+        {
+            out << "    L" << key.first << " -> ";
+            
+            if (key.second == impl::exitLine)
+                out << "exit";
+            else
+                out << 'L' << key.second;
+            
+            out << " [";
+            
+            if (edge.known)
+                out << "label=\"" << edge.count << "\", penwidth=" << 1.0 + 4.0 * impl::heat(edge.count, hottestEdge);
+            
+            if (edge.zero)
+                out << (edge.known ? ", " : "") << "style=dashed";
+            
+            out << "];\n";
+        }
+        
+        out << "}\n";
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_GRAPH_HPP
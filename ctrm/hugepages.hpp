@@ -0,0 +1,191 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_HUGEPAGES_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_HUGEPAGES_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <string>
+
+#include <sys/mman.h>
+
+//  Backs large allocations, such as the images of programs with millions of
+//  instructions and the registers of large batches, with huge pages, so that
+//  each TLB entry covers more of them. Requires a POSIX system; huge pages
+//  are only requested on Linux.
+namespace ctrm
+{
+    enum hugePageMode
+    {
+        //  Ordinary pages.
+        SMALL_PAGES,
+        
+        //  Pages which the kernel may combine into huge pages, requested with
+        //  madvise(MADV_HUGEPAGE), when transparent huge pages are enabled.
+        TRANSPARENT_HUGE_PAGES,
+        
+        //  Pages reserved by the administrator, mapped with MAP_HUGETLB.
+        EXPLICIT_HUGE_PAGES,
+    };
+    
+    namespace impl
+    {
+        //  Size of a huge page, from /proc/meminfo, or 2 MiB if it cannot be
+        //  read.
+        inline std::size_t hugePageSize()
+        {
+            static const std::size_t size{ [] {
+                std::ifstream meminfo{ "/proc/meminfo" };
+                
+                for (std::string key; meminfo >> key;)
+                {
+                    std::size_t kilobytes;
+                    
+                    if (key == "Hugepagesize:" && meminfo >> kilobytes && kilobytes != 0)
+                        return kilobytes * 1024;
+                    
+                    meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                }
+                
+                return std::size_t{ 2 } << 20;
+            }() };
+            
+            return size;
+        }
+    }
+    
+    //  A memory resource which maps allocations of at least half a huge page
+    //  directly, rounded up to whole huge pages, and passes smaller ones to
+    //  the upstream resource. Explicit huge pages fall back to transparent
+    //  ones when none are free, and transparent huge pages fall back to
+    //  ordinary pages when the kernel does not support them, so allocating
+    //  only fails when there is no memory at all. Best used as the upstream
+    //  resource of an arena with large slabs.
+    class hugePageResource : public std::pmr::memory_resource
+    {
+    public:
+        explicit hugePageResource(hugePageMode mode = TRANSPARENT_HUGE_PAGES,
+                                  std::pmr::memory_resource* upstream = std::pmr::get_default_resource()) :
+                mode{ mode },
+                upstream{ upstream }
+        {
+        }
+        
+        //  Bytes mapped so far with each mode, showing which were
+        //  available. Memory mapped with transparent huge pages may still be
+        //  made of ordinary pages, e.g. if the kernel could not find free huge
+        //  pages (see AnonHugePages in /proc/meminfo).
+        [[nodiscard]]
+        std::size_t mapped(hugePageMode m) const noexcept
+        {
+            return bytes[m].load(std::memory_order_relaxed);
+        }
+    
+    private:
+        hugePageMode mode;
+        std::pmr::memory_resource* upstream;
+        std::atomic<std::size_t> bytes[3]{};
+        
+        [[nodiscard]]
+        bool direct(std::size_t size, std::size_t alignment) const
+        {
+            return size >= impl::hugePageSize() / 2 && alignment <= impl::hugePageSize();
+        }
+        
+        [[nodiscard]]
+        static std::size_t roundUp(std::size_t size)
+        {
+            const std::size_t page{ impl::hugePageSize() };
+            return (size + page - 1) / page * page;
+        }
+        
+        static void* map(std::size_t size, int flags) noexcept
+        {
+            void* p{ ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0) };
+            return p == MAP_FAILED ? nullptr : p;
+        }
+        
+        void* do_allocate(std::size_t size, std::size_t alignment) override
+        {
+            if (!direct(size, alignment))
+                return upstream->allocate(size, alignment);
+            
+            const std::size_t page{ impl::hugePageSize() };
+            size = roundUp(size);
+            
+#ifdef MAP_HUGETLB
+            if (mode == EXPLICIT_HUGE_PAGES)
+            {
+                if (void* p{ map(size, MAP_HUGETLB) })
+                {
+                    bytes[EXPLICIT_HUGE_PAGES] += size;
+                    return p;
+                }
+            }
+#endif
+            
+            //  Map an extra huge page, so that the region can be trimmed to
+            //  start on a huge page boundary, as only aligned huge pages can
+            //  back it
+            auto* p{ static_cast<std::byte*>(map(size + page, 0)) };
+            
+            if (p == nullptr)
+                throw std::bad_alloc{};
+            
+            const std::size_t head{ (page - reinterpret_cast<std::uintptr_t>(p) % page) % page };
+            
+            if (head != 0)
+                ::munmap(p, head);
+            
+            ::munmap(p + head + size, page - head);
+            p += head;
+            
+#ifdef MADV_HUGEPAGE
+            if (mode != SMALL_PAGES && ::madvise(p, size, MADV_HUGEPAGE) == 0)
+            {
+                bytes[TRANSPARENT_HUGE_PAGES] += size;
+                return p;
+            }
+#endif
+            
+            bytes[SMALL_PAGES] += size;
+            return p;
+        }
+        
+        void do_deallocate(void* p, std::size_t size, std::size_t alignment) override
+        {
+            if (!direct(size, alignment))
+            {
+                upstream->deallocate(p, size, alignment);
+                return;
+            }
+            
+            ::munmap(p, roundUp(size));
+        }
+        
+        [[nodiscard]]
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_HUGEPAGES_HPP
@@ -0,0 +1,477 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_METRICS_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if __has_include(<sys/socket.h>) && __has_include(<sys/un.h>) && __has_include(<unistd.h>)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define CTRM_METRICS_HAS_UNIX_SOCKETS 1
+#endif
+
+//  Metrics are only recorded when CTRM_METRICS is defined before this header
+//  is included. Otherwise every recording function is an empty inline
+//  function and no per-thread state is ever created.
+namespace ctrm::metrics
+{
+    enum counter : std::size_t
+    {
+        PROGRAMS_EXECUTED,
+        INSTRUCTIONS_DISPATCHED,
+        FUEL_EXHAUSTED,
+        SUPERINSTRUCTIONS_DISPATCHED,
+        EXECUTIONS_CANCELLED,
+        COUNTER_COUNT,
+    };
+    
+    enum histogram : std::size_t
+    {
+        RUN_DURATION,
+        HISTOGRAM_COUNT,
+    };
+    
+    //  Gauges describe each program which has been given a name, rather than
+    //  executions, so they are recorded once per process rather than per
+    //  thread.
+    enum gauge : std::size_t
+    {
+        PROGRAM_INSTRUCTIONS,
+        PROGRAM_INCREMENTS,
+        PROGRAM_DECREMENTS,
+        PROGRAM_HALTS,
+        PROGRAM_REGISTERS,
+        PROGRAM_REACHABLE_INSTRUCTIONS,
+        PROGRAM_LOOPS,
+        PROGRAM_LOOP_DEPTH,
+        PROGRAM_LARGEST_COMPONENT,
+        PROGRAM_COST_CLASS,
+        GAUGE_COUNT,
+    };
+    
+    namespace impl
+    {
+        struct description
+        {
+            const char* name;
+            const char* help;
+        };
+        
+        inline constexpr std::array<description, COUNTER_COUNT> counters{{
+                { "ctrm_programs_executed_total", "Number of programs executed at run-time." },
+                { "ctrm_instructions_dispatched_total", "Number of instructions executed at run-time." },
+                { "ctrm_fuel_exhausted_total", "Number of executions stopped by running out of fuel." },
+                { "ctrm_superinstructions_dispatched_total", "Number of superinstructions executed at run-time." },
+                { "ctrm_executions_cancelled_total", "Number of executions stopped by cancellation or a deadline." },
+        }};
+        
+        inline constexpr std::array<description, HISTOGRAM_COUNT> histograms{{
+                { "ctrm_run_duration_seconds", "Wall clock time taken by a single execution." },
+        }};
+        
+        inline constexpr std::array<description, GAUGE_COUNT> gauges{{
+                { "ctrm_program_instructions", "Number of instructions in a program." },
+                { "ctrm_program_increments", "Number of increment instructions in a program." },
+                { "ctrm_program_decrements", "Number of decrement instructions in a program." },
+                { "ctrm_program_halts", "Number of halt instructions in a program." },
+                { "ctrm_program_registers", "Number of registers used by a program." },
+                { "ctrm_program_reachable_instructions", "Number of instructions which can be reached in a program." },
+                { "ctrm_program_loops", "Number of loops in a program, including nested loops." },
+                { "ctrm_program_loop_depth", "Deepest nesting of loops in a program." },
+                { "ctrm_program_largest_component", "Number of instructions in the largest loop of a program." },
+                { "ctrm_program_cost_class", "Estimated cost of a program: 0 constant, 1 linear, 2 polynomial, 3 unbounded." },
+        }};
+        
+        using gaugeValues = std::array<std::uint64_t, GAUGE_COUNT>;
+        
+        //  Upper bounds of the histogram buckets in nanoseconds. A final
+        //  bucket without an upper bound follows the last one.
+        inline constexpr std::array<std::uint64_t, 13> bounds{
+                1'000, 5'000, 10'000, 50'000, 100'000, 500'000, 1'000'000,
+                5'000'000, 10'000'000, 50'000'000, 100'000'000, 500'000'000, 1'000'000'000 };
+        
+        //  Plain totals, used when metrics from several threads are combined.
+        struct totals
+        {
+            std::array<std::uint64_t, COUNTER_COUNT> counters{};
+            std::array<std::array<std::uint64_t, bounds.size() + 1>, HISTOGRAM_COUNT> buckets{};
+            std::array<std::uint64_t, HISTOGRAM_COUNT> sums{};
+        };
+        
+        //  Metrics recorded by a single thread. Only the owning thread writes
+        //  to its shard, so updates are a relaxed load and store rather than
+        //  a locked read-modify-write. Other threads only ever read them.
+        struct shard
+        {
+            std::array<std::atomic<std::uint64_t>, COUNTER_COUNT> counters{};
+            std::array<std::array<std::atomic<std::uint64_t>, bounds.size() + 1>, HISTOGRAM_COUNT> buckets{};
+            std::array<std::atomic<std::uint64_t>, HISTOGRAM_COUNT> sums{};
+            
+            void addTo(totals& t) const
+            {
+                for (std::size_t i{ 0 }; i < COUNTER_COUNT; ++i)
+                    t.counters[i] += counters[i].load(std::memory_order_relaxed);
+                
+                for (std::size_t i{ 0 }; i < HISTOGRAM_COUNT; ++i)
+                {
+                    for (std::size_t j{ 0 }; j < buckets[i].size(); ++j)
+                        t.buckets[i][j] += buckets[i][j].load(std::memory_order_relaxed);
+                    
+                    t.sums[i] += sums[i].load(std::memory_order_relaxed);
+                }
+            }
+        };
+        
+        //  Formats a number of nanoseconds as seconds without losing precision.
+        inline std::string seconds(std::uint64_t ns)
+        {
+            std::array<char, 32> buffer{};
+            std::snprintf(buffer.data(), buffer.size(), "%.9g", static_cast<double>(ns) / 1e9);
+            return buffer.data();
+        }
+        
+        inline void bump(std::atomic<std::uint64_t>& value, std::uint64_t n)
+        {
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+        
+        //  Escapes a label value for the exposition format.
+        inline std::string escape(std::string_view value)
+        {
+            std::string result;
+            
+            for (const char c : value)
+            {
+                if (c == '\\' || c == '"')
+                    result += '\\';
+                
+                if (c == '\n')
+                    result += "\\n";
+                else
+                    result += c;
+            }
+            
+            return result;
+        }
+        
+        //  Keeps track of the shards of every running thread, and the totals
+        //  of threads which have since exited.
+        class registry
+        {
+        private:
+            mutable std::mutex mutex;
+            std::vector<const shard*> shards;
+            totals retired;
+            std::vector<std::pair<std::string, gaugeValues>> programs;
+        
+        public:
+            //  The registry is intentionally leaked, as threads may still
+            //  be exiting while static objects are being destroyed.
+            static registry& instance()
+            {
+                static registry* r{ new registry };
+                return *r;
+            }
+            
+            void attach(const shard* s)
+            {
+                const std::lock_guard lock{ mutex };
+                shards.push_back(s);
+            }
+            
+            void detach(const shard* s)
+            {
+                const std::lock_guard lock{ mutex };
+                s->addTo(retired);
+                std::erase(shards, s);
+            }
+            
+            [[nodiscard]]
+            totals collect() const
+            {
+                const std::lock_guard lock{ mutex };
+                totals t{ retired };
+                
+                for (const shard* s : shards)
+                    s->addTo(t);
+                
+                return t;
+            }
+            
+            void describe(std::string_view program, const gaugeValues& values)
+            {
+                const std::lock_guard lock{ mutex };
+                
+                for (auto& [name, existing] : programs)
+                {
+                    if (name == program)
+                    {
+                        existing = values;
+                        return;
+                    }
+                }
+                
+                programs.emplace_back(program, values);
+            }
+            
+            [[nodiscard]]
+            std::vector<std::pair<std::string, gaugeValues>> described() const
+            {
+                const std::lock_guard lock{ mutex };
+                return programs;
+            }
+        };
+        
+        struct local
+        {
+            shard data;
+            
+            local()
+            {
+                registry::instance().attach(&data);
+            }
+            
+            ~local()
+            {
+                registry::instance().detach(&data);
+            }
+        };
+        
+        inline shard& localShard()
+        {
+            thread_local local l;
+            return l.data;
+        }
+    }
+    
+#ifdef CTRM_METRICS
+    //  The recording functions live in an inline namespace named after
+    //  whether metrics are enabled, so that translation units built with and
+    //  without CTRM_METRICS never share a definition.
+    inline namespace enabled
+    {
+        //  Adds n to a counter on behalf of the calling thread.
+        inline void add(counter c, std::uint64_t n = 1)
+        {
+            impl::bump(impl::localShard().counters[c], n);
+        }
+        
+        //  Records a single duration in a histogram on behalf of the calling
+        //  thread.
+        inline void observe(histogram h, std::chrono::nanoseconds duration)
+        {
+            const auto ns{ static_cast<std::uint64_t>(duration.count()) };
+            std::size_t bucket{ 0 };
+            
+            while (bucket < impl::bounds.size() && ns > impl::bounds[bucket])
+                ++bucket;
+            
+            auto& s{ impl::localShard() };
+            impl::bump(s.buckets[h][bucket], 1);
+            impl::bump(s.sums[h], ns);
+        }
+        
+        //  Sets every gauge describing the named program, replacing any
+        //  values previously set for a program of the same name.
+        inline void describe(std::string_view program, const impl::gaugeValues& values)
+        {
+            impl::registry::instance().describe(program, values);
+        }
+        
+        //  Records the lifetime of the timer in a histogram.
+        class timer
+        {
+        private:
+            histogram h;
+            std::chrono::steady_clock::time_point start{ std::chrono::steady_clock::now() };
+        
+        public:
+            explicit timer(histogram hist) :
+                    h{ hist }
+            {
+            }
+            
+            timer(const timer&) = delete;
+            timer& operator=(const timer&) = delete;
+            
+            ~timer()
+            {
+                observe(h, std::chrono::steady_clock::now() - start);
+            }
+        };
+    }
+#else
+    //  Without CTRM_METRICS, every recording function does nothing and the
+    //  timer never reads the clock.
+    inline namespace disabled
+    {
+        inline void add(counter, std::uint64_t = 1)
+        {
+        }
+        
+        inline void observe(histogram, std::chrono::nanoseconds)
+        {
+        }
+        
+        inline void describe(std::string_view, const impl::gaugeValues&)
+        {
+        }
+        
+        class timer
+        {
+        public:
+            explicit timer(histogram)
+            {
+            }
+            
+            timer(const timer&) = delete;
+            timer& operator=(const timer&) = delete;
+        };
+    }
+#endif
+    
+    //  Writes the current value of every metric, summed over all threads,
+    //  in the Prometheus text exposition format.
+    inline void write(std::ostream& out)
+    {
+        const impl::totals t{ impl::registry::instance().collect() };
+        
+        for (std::size_t i{ 0 }; i < COUNTER_COUNT; ++i)
+        {
+            const auto& d{ impl::counters[i] };
+            out << "# HELP " << d.name << ' ' << d.help << '\n'
+                << "# TYPE " << d.name << " counter\n"
+                << d.name << ' ' << t.counters[i] << '\n';
+        }
+        
+        for (std::size_t i{ 0 }; i < HISTOGRAM_COUNT; ++i)
+        {
+            const auto& d{ impl::histograms[i] };
+            out << "# HELP " << d.name << ' ' << d.help << '\n'
+                << "# TYPE " << d.name << " histogram\n";
+            
+            std::uint64_t cumulative{ 0 };
+            for (std::size_t j{ 0 }; j < t.buckets[i].size(); ++j)
+            {
+                cumulative += t.buckets[i][j];
+                out << d.name << "_bucket{le=\"";
+                
+                if (j < impl::bounds.size())
+                    out << impl::seconds(impl::bounds[j]);
+                else
+                    out << "+Inf";
+                
+                out << "\"} " << cumulative << '\n';
+            }
+            
+            out << d.name << "_sum " << impl::seconds(t.sums[i]) << '\n'
+                << d.name << "_count " << cumulative << '\n';
+        }
+        
+        const auto programs{ impl::registry::instance().described() };
+        
+        for (std::size_t i{ 0 }; i < GAUGE_COUNT && !programs.empty(); ++i)
+        {
+            const auto& d{ impl::gauges[i] };
+            out << "# HELP " << d.name << ' ' << d.help << '\n'
+                << "# TYPE " << d.name << " gauge\n";
+            
+            for (const auto& [name, values] : programs)
+                out << d.name << "{program=\"" << impl::escape(name) << "\"} " << values[i] << '\n';
+        }
+    }
+    
+    //  Writes every metric to a file, replacing it atomically so that a
+    //  collector reading the file never sees a partial scrape (e.g. for
+    //  the node_exporter textfile collector). Returns false on failure.
+    inline bool writeFile(const std::string& path)
+    {
+        const std::string temporary{ path + ".tmp" };
+        
+        {
+            std::ofstream file{ temporary, std::ios::trunc };
+            write(file);
+            
+            if (!file.flush())
+                return false;
+        }
+        
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+#ifdef CTRM_METRICS_HAS_UNIX_SOCKETS
+    //  Connects to a local (Unix domain) stream socket and sends every metric
+    //  over it. Returns false if the socket could not be reached or was closed
+    //  by the reader, which never raises SIGPIPE.
+    inline bool writeSocket(const std::string& path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        
+        if (path.size() >= sizeof(address.sun_path))
+            return false;
+        
+        path.copy(address.sun_path, path.size());
+        
+        const int fd{ ::socket(AF_UNIX, SOCK_STREAM, 0) };
+        if (fd < 0)
+            return false;
+        
+#ifdef MSG_NOSIGNAL
+        constexpr int flags{ MSG_NOSIGNAL };
+#else
+        constexpr int flags{ 0 };
+        const int enable{ 1 };
+        ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+        
+        std::ostringstream text;
+        write(text);
+        const std::string data{ text.str() };
+        
+        bool success{ ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0 };
+        
+        for (std::size_t sent{ 0 }; success && sent < data.size();)
+        {
+            const auto n{ ::send(fd, data.data() + sent, data.size() - sent, flags) };
+            
+            if (n < 0 && errno == EINTR)
+                continue;
+            
+            success = n > 0;
+            sent += success ? static_cast<std::size_t>(n) : 0;
+        }
+        
+        ::close(fd);
+        return success;
+    }
+#endif
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_METRICS_HPP
@@ -0,0 +1,626 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_OPTIMISE_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_OPTIMISE_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "runtime.hpp"
+
+//  Passes which transform a program into a smaller or faster program with
+//  the same behaviour. Each pass is available at compile time for programs,
+//  and at run-time for images. Line numbers may change, so the location in
+//  a status may differ from that of the original program.
+namespace ctrm
+{
+    namespace impl
+    {
+        //  Divides the lines into classes of lines which behave the same:
+        //  those with the same instruction whose successors are in the same
+        //  classes. Returns the class of every line.
+        //
+        //  Lines which cannot reach a loop are hash-consed bottom-up, from
+        //  those which halt, in order of the length of the longest path to a
+        //  halt. The remaining lines are then refined from a single class
+        //  until no class is split (Moore's algorithm).
+        constexpr std::vector<std::size_t> partition(std::span<const instruction> instructions)
+        {
+            using key = std::array<std::size_t, 4>;
+            constexpr std::size_t infinite{ std::numeric_limits<std::size_t>::max() };
+            const std::size_t n{ instructions.size() };
+            
+            std::vector<std::size_t> classes(n);
+            std::vector<std::size_t> heights(n, 0);
+            std::vector<unsigned char> state(n, 0);
+            std::vector<std::size_t> stack;
+            
+            //  Find the length of the longest path to a halt with a depth
+            //  first search. A successor which is still being searched lies
+            //  on a loop with the current line.
+            for (std::size_t root{ 0 }; root < n; ++root)
+            {
+                if (state[root] != 0)
+                    continue;
+                
+                state[root] = 1;
+                stack.push_back(root);
+                
+                while (!stack.empty())
+                {
+                    const std::size_t line{ stack.back() };
+                    bool descended{ false };
+                    
+                    for (std::size_t k{ 0 }; k < 2 && !descended; ++k)
+                    {
+                        const std::size_t s{ successor(instructions, line, k) };
+                        
+                        if (s != exitLine && state[s] == 0)
+                        {
+                            state[s] = 1;
+                            stack.push_back(s);
+                            descended = true;
+                        }
+                    }
+                    
+                    if (descended)
+                        continue;
+                    
+                    for (std::size_t k{ 0 }; k < 2 && instructions[line].type != HALT; ++k)
+                    {
+                        const std::size_t s{ successor(instructions, line, k) };
+                        const std::size_t h{ s == exitLine ? 0 : state[s] == 1 ? infinite : heights[s] };
+                        heights[line] = std::max(heights[line], h == infinite ? infinite : h + 1);
+                    }
+                    
+                    state[line] = 2;
+                    stack.pop_back();
+                }
+            }
+            
+            std::vector<key> keys(n);
+            
+            //  Sorts lines by their instruction and the classes of their
+            //  successors, and gives each distinct key the next class from
+            //  next. Returns the class following the last one given.
+            const auto assign{ [&](std::span<std::size_t> lines, std::size_t next) {
+                for (const std::size_t line : lines)
+                {
+                    const auto& ins{ instructions[line] };
+                    const std::size_t s1{ successor(instructions, line, 0) };
+                    const std::size_t s2{ successor(instructions, line, 1) };
+                    
+                    keys[line] = { ins.type, ins.type == HALT ? 0 : ins.currentRegister,
+                                   s1 == exitLine ? exitLine : classes[s1], s2 == exitLine ? exitLine : classes[s2] };
+                }
+                
+                std::sort(lines.begin(), lines.end(), [&](std::size_t a, std::size_t b) { return keys[a] < keys[b]; });
+                
+                for (std::size_t i{ 0 }; i < lines.size(); ++i)
+                {
+                    if (i != 0 && keys[lines[i]] != keys[lines[i - 1]])
+                        ++next;
+                    
+                    classes[lines[i]] = next;
+                }
+                
+                return lines.empty() ? next : next + 1;
+            } };
+            
+            std::vector<std::size_t> acyclic;
+            std::vector<std::size_t> cyclic;
+            
+            for (std::size_t line{ 0 }; line < n; ++line)
+                (heights[line] == infinite ? cyclic : acyclic).push_back(line);
+            
+            std::sort(acyclic.begin(), acyclic.end(), [&](std::size_t a, std::size_t b) {
+                return heights[a] < heights[b] || (heights[a] == heights[b] && a < b);
+            });
+            
+            //  The successors of a line are always lower than the line, so
+            //  are already in their final classes
+            std::size_t next{ 0 };
+            
+            for (std::size_t begin{ 0 }, end{ 0 }; begin < acyclic.size(); begin = end)
+            {
+                while (end < acyclic.size() && heights[acyclic[end]] == heights[acyclic[begin]])
+                    ++end;
+                
+                next = assign(std::span{ acyclic }.subspan(begin, end - begin), next);
+            }
+            
+            //  Every split is a refinement, so the classes are final once
+            //  their number stops growing
+            for (const std::size_t line : cyclic)
+                classes[line] = next;
+            
+            for (std::size_t count{ 1 }, previous{ 0 }; count != previous;)
+            {
+                previous = count;
+                count = assign(cyclic, next) - next;
+            }
+            
+            return classes;
+        }
+        
+        //  Merges lines which behave the same and removes lines which cannot
+        //  be reached, keeping the first line first.
+        constexpr std::vector<instruction> merge(std::span<const instruction> instructions)
+        {
+            const auto classes{ partition(instructions) };
+            const auto live{ reachable(instructions) };
+            std::vector<std::size_t> lines(instructions.size(), exitLine);
+            std::vector<std::size_t> representatives;
+            
+            for (std::size_t line{ 0 }; line < instructions.size(); ++line)
+            {
+                if (live[line] && lines[classes[line]] == exitLine)
+                {
+                    lines[classes[line]] = representatives.size();
+                    representatives.push_back(line);
+                }
+            }
+            
+            const auto target{ [&](std::size_t line, std::size_t k) {
+                const std::size_t s{ successor(instructions, line, k) };
+                return s == exitLine ? representatives.size() : lines[classes[s]];
+            } };
+            
+            std::vector<instruction> result;
+            result.reserve(representatives.size());
+            
+            for (const std::size_t line : representatives)
+            {
+                const auto& ins{ instructions[line] };
+                
+                if (ins.type == HALT)
+                    result.emplace_back();
+                else if (ins.type == INCR)
+                    result.emplace_back(ins.currentRegister, target(line, 0));
+                else
+                    result.emplace_back(ins.currentRegister, target(line, 0), target(line, 1));
+            }
+            
+            return result;
+        }
+        
+        //  For every line, whether each register is zero whenever the line is
+        //  reached (at line * registerCount + register), given that the
+        //  registers from inputs on start at zero. A decrement which finds
+        //  its register at zero leaves it at zero, while an increment or a
+        //  successful decrement may leave any value.
+        constexpr std::vector<bool> zeros(std::span<const instruction> instructions, std::size_t registerCount,
+                                          std::size_t inputs)
+        {
+            const std::size_t n{ instructions.size() };
+            const auto live{ reachable(instructions) };
+            std::vector<bool> result(n * registerCount, true);
+            
+            while (true)
+            {
+                std::vector<bool> next(n * registerCount, true);
+                
+                for (std::size_t r{ 0 }; n != 0 && r < inputs; ++r)
+                    next[r] = false;
+                
+                for (std::size_t line{ 0 }; line < n; ++line)
+                {
+                    const auto& ins{ instructions[line] };
+                    
+                    for (std::size_t k{ 0 }; k < 2 && live[line]; ++k)
+                    {
+                        const std::size_t s{ successor(instructions, line, k) };
+                        
+                        for (std::size_t r{ 0 }; s != exitLine && r < registerCount; ++r)
+                        {
+                            const bool zero{ r == ins.currentRegister ? ins.type == DECR && k == 1
+                                                                      : result[line * registerCount + r] };
+                            next[s * registerCount + r] = next[s * registerCount + r] && zero;
+                        }
+                    }
+                }
+                
+                if (next == result)
+                    return result;
+                
+                result = std::move(next);
+            }
+        }
+        
+        //  A loop which moves the value of one register onto others: a
+        //  decrement of the source, followed by increments of each target
+        //  leading back to the decrement. Targets may be repeated.
+        struct transfer
+        {
+            std::size_t source;
+            std::size_t exit;
+            std::vector<std::size_t> targets;
+            std::vector<std::size_t> lines;
+        };
+        
+        constexpr bool findTransfer(std::span<const instruction> instructions, std::size_t line, transfer& t)
+        {
+            if (line >= instructions.size() || instructions[line].type != DECR)
+                return false;
+            
+            t.source = instructions[line].currentRegister;
+            t.exit = instructions[line].location2;
+            t.targets.clear();
+            t.lines.assign(1, line);
+            
+            for (std::size_t loc{ instructions[line].location1 }; loc != line; loc = instructions[loc].location1)
+            {
+                if (loc >= instructions.size() || instructions[loc].type != INCR
+                    || instructions[loc].currentRegister == t.source || t.lines.size() == maxCycleLength)
+                    return false;
+                
+                t.targets.push_back(instructions[loc].currentRegister);
+                t.lines.push_back(loc);
+            }
+            
+            return true;
+        }
+        
+        //  Replaces a transfer A of s, which is followed by transfers L1 to
+        //  Lk, with one which also carries out Lk, when Lk moves a target d
+        //  of A which is zero before A onward (so Lk only moves what A moved
+        //  onto d). L1 to L(k-1) must not use d or the targets of Lk, so that
+        //  Lk can be moved before them, and must only be reached through A.
+        //  This turns moves through a temporary into a single move, and a
+        //  copy of s through a temporary restored to s followed by a move of
+        //  the copy into a copy straight to its destination. Returns whether
+        //  any transfers were combined.
+        constexpr bool combineTransfers(std::vector<instruction>& instructions, std::size_t inputs,
+                                        std::size_t registerCount)
+        {
+            constexpr std::size_t maxChain{ 8 };
+            const std::size_t n{ instructions.size() };
+            const auto live{ reachable(instructions) };
+            const auto zero{ zeros(instructions, registerCount, inputs) };
+            
+            std::vector<std::size_t> predecessors;
+            std::vector<std::size_t> first(n + 1, 0);
+            
+            for (std::size_t pass{ 0 }; pass < 2; ++pass)
+            {
+                std::vector<std::size_t> filled(first.begin(), first.end() - 1);
+                predecessors.resize(first[n]);
+                
+                for (std::size_t line{ 0 }; line < n; ++line)
+                {
+                    for (std::size_t k{ 0 }; k < 2 && live[line]; ++k)
+                    {
+                        const std::size_t s{ successor(instructions, line, k) };
+                        
+                        if (s == exitLine)
+                            continue;
+                        
+                        if (pass == 0)
+                            ++first[s + 1];
+                        else
+                            predecessors[filled[s]++] = line * 2 + k;
+                    }
+                }
+                
+                for (std::size_t line{ 0 }; pass == 0 && line < n; ++line)
+                    first[line + 1] += first[line];
+            }
+            
+            //  Lines only reachable from within their own transfer, or from
+            //  the preceding line in a chain
+            const auto entries{ [&](std::size_t line) { return first[line + 1] - first[line] + (line == 0 ? 1 : 0); } };
+            const auto contains{ [](const std::vector<std::size_t>& v, std::size_t x) {
+                return std::find(v.begin(), v.end(), x) != v.end();
+            } };
+            
+            std::vector<bool> changed(n, false);
+            bool result{ false };
+            transfer a;
+            
+            for (std::size_t h{ 0 }; h < n; ++h)
+            {
+                if (!live[h] || changed[h] || !findTransfer(instructions, h, a))
+                    continue;
+                
+                bool enclosed{ true };
+                
+                for (std::size_t i{ 1 }; i < a.lines.size(); ++i)
+                    enclosed = enclosed && entries(a.lines[i]) == 1 && !changed[a.lines[i]];
+                
+                //  Whether d is zero whenever A is entered from outside
+                const auto zeroBefore{ [&](std::size_t d) {
+                    if (d >= registerCount || (h == 0 && d < inputs))
+                        return false;
+                    
+                    for (std::size_t i{ first[h] }; i < first[h + 1]; ++i)
+                    {
+                        const std::size_t p{ predecessors[i] / 2 };
+                        const std::size_t k{ predecessors[i] % 2 };
+                        const auto& ins{ instructions[p] };
+                        
+                        if (contains(a.lines, p))
+                            continue;
+                        
+                        if (ins.currentRegister == d ? !(ins.type == DECR && k == 1) : !zero[p * registerCount + d])
+                            return false;
+                    }
+                    
+                    return true;
+                } };
+                
+                std::vector<transfer> chain;
+                transfer l;
+                
+                for (std::size_t loc{ a.exit }; enclosed && chain.size() < maxChain; loc = l.exit)
+                {
+                    if (!findTransfer(instructions, loc, l) || contains(a.lines, loc))
+                        break;
+                    
+                    const auto m{ static_cast<std::size_t>(std::count(a.targets.begin(), a.targets.end(), l.source)) };
+                    bool movable{ m != 0 && !contains(l.targets, a.source)
+                                  && a.targets.size() - m + m * l.targets.size() < maxCycleLength && zeroBefore(l.source) };
+                    
+                    for (const auto& c : chain)
+                    {
+                        movable = movable && c.source != l.source && !contains(l.targets, c.source)
+                                  && !contains(c.targets, l.source);
+                        
+                        for (const std::size_t t : c.targets)
+                            movable = movable && !contains(l.targets, t);
+                    }
+                    
+                    if (movable)
+                    {
+                        //  Build the new transfer from new lines
+                        std::vector<std::size_t> targets;
+                        
+                        for (const std::size_t t : a.targets)
+                        {
+                            if (t == l.source)
+                                targets.insert(targets.end(), l.targets.begin(), l.targets.end());
+                            else
+                                targets.push_back(t);
+                        }
+                        
+                        instructions[h].location1 = targets.empty() ? h : instructions.size();
+                        
+                        for (std::size_t i{ 0 }; i < targets.size(); ++i)
+                            instructions.emplace_back(targets[i], i + 1 < targets.size() ? instructions.size() + 1 : h);
+                        
+                        instructions[chain.empty() ? h : chain.back().lines[0]].location2 = l.exit;
+                        
+                        for (const auto& c : chain)
+                            for (const std::size_t line : c.lines)
+                                changed[line] = true;
+                        
+                        for (const std::size_t line : a.lines)
+                            changed[line] = true;
+                        
+                        for (const std::size_t line : l.lines)
+                            changed[line] = true;
+                        
+                        result = true;
+                        break;
+                    }
+                    
+                    //  Continue past L only if it is a part of the chain alone
+                    bool single{ loc != 0 && entries(loc) == 2 && !changed[loc] };
+                    
+                    for (std::size_t i{ 1 }; i < l.lines.size(); ++i)
+                        single = single && entries(l.lines[i]) == 1 && !changed[l.lines[i]];
+                    
+                    if (!single)
+                        break;
+                    
+                    chain.push_back(l);
+                }
+            }
+            
+            return result;
+        }
+        
+        //  Gives registers from inputs on the same number when one is always
+        //  zero wherever the other is used, so that their sum behaves as
+        //  each would, and removes registers from inputs on which are never
+        //  used. Returns the new number of registers.
+        constexpr std::size_t coalesceRegisters(std::vector<instruction>& instructions, std::size_t inputs,
+                                                std::size_t registerCount)
+        {
+            const auto live{ reachable(instructions) };
+            const auto uses{ [&](std::size_t r) {
+                for (std::size_t line{ 0 }; line < instructions.size(); ++line)
+                    if (live[line] && instructions[line].type != HALT && instructions[line].currentRegister == r)
+                        return true;
+                
+                return false;
+            } };
+            
+            for (bool merged{ true }; merged;)
+            {
+                merged = false;
+                const auto zero{ zeros(instructions, registerCount, inputs) };
+                
+                for (std::size_t a{ inputs }; a < registerCount && !merged; ++a)
+                {
+                    for (std::size_t b{ a + 1 }; b < registerCount && !merged && uses(a); ++b)
+                    {
+                        bool disjoint{ uses(b) };
+                        
+                        for (std::size_t line{ 0 }; line < instructions.size() && disjoint; ++line)
+                        {
+                            const auto& ins{ instructions[line] };
+                            
+                            if (live[line] && ins.type != HALT && ins.currentRegister == a)
+                                disjoint = zero[line * registerCount + b];
+                            else if (live[line] && ins.type != HALT && ins.currentRegister == b)
+                                disjoint = zero[line * registerCount + a];
+                        }
+                        
+                        for (auto& ins : instructions)
+                            if (disjoint && ins.type != HALT && ins.currentRegister == b)
+                                ins.currentRegister = a;
+                        
+                        merged = disjoint;
+                    }
+                }
+            }
+            
+            std::vector<std::size_t> numbers(registerCount);
+            std::size_t count{ inputs };
+            
+            for (std::size_t r{ 0 }; r < registerCount; ++r)
+                numbers[r] = r < inputs ? r : uses(r) ? count++ : 0;
+            
+            for (auto& ins : instructions)
+                if (ins.type != HALT)
+                    ins.currentRegister = numbers[ins.currentRegister];
+            
+            return std::max<std::size_t>(count, 1);
+        }
+        
+        //  Combines transfers and coalesces registers, merging the program
+        //  after each round. R0 is always kept, as it holds the result.
+        //  Returns the new number of registers.
+        constexpr std::size_t propagate(std::vector<instruction>& instructions, std::size_t registerCount,
+                                        std::size_t inputs)
+        {
+            inputs = std::clamp<std::size_t>(inputs, 1, std::max<std::size_t>(registerCount, 1));
+            
+            do
+            {
+                instructions = merge(instructions);
+                
+                //  Keep jumps out of the program outside it as lines are added
+                for (auto& ins : instructions)
+                {
+                    if (ins.location1 >= instructions.size())
+                        ins.location1 = exitLine;
+                    
+                    if (ins.type == DECR && ins.location2 >= instructions.size())
+                        ins.location2 = exitLine;
+                }
+            }
+            while (combineTransfers(instructions, inputs, registerCount));
+            
+            registerCount = coalesceRegisters(instructions, inputs, registerCount);
+            instructions = merge(instructions);
+            return registerCount;
+        }
+        
+        template<std::size_t count>
+        consteval std::array<instruction, count> toArray(const std::vector<instruction>& instructions)
+        {
+            if (instructions.size() != count)
+                error("Error: program has a different number of instructions after optimising");
+            
+            std::array<instruction, count> result{};
+            std::copy(instructions.begin(), instructions.end(), result.begin());
+            return result;
+        }
+    }
+    
+    //  Number of instructions in a program once merged with merge().
+    template<std::size_t maxRegisters, std::size_t instrCount>
+    [[maybe_unused]] [[nodiscard]]
+    consteval std::size_t mergedCount(const program<maxRegisters, instrCount>& p)
+    {
+        return impl::merge(p.instructions).size();
+    }
+    
+    //  Merges identical instruction sequences in a program at compile time:
+    //  lines with the same instruction whose jumps lead to lines which are
+    //  merged themselves, including across loops. Lines which cannot be
+    //  reached are removed. As the number of instructions is part of the
+    //  type, it must be given, e.g. ctrm::merge<ctrm::mergedCount(p)>(p).
+    template<std::size_t count, std::size_t maxRegisters, std::size_t instrCount>
+    [[maybe_unused]] [[nodiscard]]
+    consteval program<maxRegisters, count> merge(const program<maxRegisters, instrCount>& p)
+    {
+        return program<maxRegisters, count>{ impl::toArray<count>(impl::merge(p.instructions)) };
+    }
+    
+    //  Merges identical instruction sequences in an image at run-time.
+    [[maybe_unused]] [[nodiscard]]
+    inline image merge(const image& p)
+    {
+        const auto instructions{ impl::merge(p.instructions) };
+        image result;
+        result.registerCount = p.registerCount;
+        result.instructions.assign(instructions.begin(), instructions.end());
+        result.analyse();
+        return result;
+    }
+    
+    //  Number of registers and instructions of a program.
+    struct shape
+    {
+        std::size_t registers;
+        std::size_t instructions;
+    };
+    
+    //  Shape of a program once optimised with propagate().
+    template<std::size_t maxRegisters, std::size_t instrCount>
+    [[maybe_unused]] [[nodiscard]]
+    consteval shape propagatedShape(const program<maxRegisters, instrCount>& p, std::size_t inputs)
+    {
+        std::vector<impl::instruction> instructions(p.instructions.begin(), p.instructions.end());
+        const std::size_t registers{ impl::propagate(instructions, maxRegisters, inputs) };
+        return { registers, instructions.size() };
+    }
+    
+    //  Removes moves through temporary registers from a program at compile
+    //  time: a move onto a temporary followed by a move from it becomes a
+    //  single move, and so does a copy onto a temporary which is restored
+    //  to the original register followed by a move from the copy. Registers
+    //  which are then unused are removed, and registers which are never
+    //  in use at the same time are combined.
+    //
+    //  The first inputs registers, which may be given as arguments to
+    //  exec(), keep their numbers and final values. Other registers must
+    //  start at zero, as they do in exec(), and may be renumbered. Fewer
+    //  steps are taken, and the shape must be given explicitly, e.g.
+    //  ctrm::propagate<ctrm::propagatedShape(p, 3)>(p, 3).
+    template<shape s, std::size_t maxRegisters, std::size_t instrCount>
+    [[maybe_unused]] [[nodiscard]]
+    consteval program<s.registers, s.instructions> propagate(const program<maxRegisters, instrCount>& p,
+                                                             std::size_t inputs)
+    {
+        std::vector<impl::instruction> instructions(p.instructions.begin(), p.instructions.end());
+        
+        if (impl::propagate(instructions, maxRegisters, inputs) != s.registers)
+            error("Error: program has a different number of registers after optimising");
+        
+        return program<s.registers, s.instructions>{ impl::toArray<s.instructions>(instructions) };
+    }
+    
+    //  Removes moves through temporary registers from an image at run-time,
+    //  as above.
+    [[maybe_unused]] [[nodiscard]]
+    inline image propagate(const image& p, std::size_t inputs)
+    {
+        std::vector<impl::instruction> instructions(p.instructions.begin(), p.instructions.end());
+        image result;
+        result.registerCount = impl::propagate(instructions, p.registerCount, inputs);
+        result.instructions.assign(instructions.begin(), instructions.end());
+        result.analyse();
+        return result;
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_OPTIMISE_HPP
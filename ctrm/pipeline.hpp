@@ -0,0 +1,464 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_PIPELINE_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_PIPELINE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "runtime.hpp"
+
+//  Pipelines of programs, in which registers left by one stage are the
+//  initial registers of the next. Stages run concurrently on a pool of
+//  worker threads and pass rows to each other in batches through bounded
+//  queues, so that no intermediate results are held in full.
+namespace ctrm
+{
+    namespace impl
+    {
+        //  A bounded queue with a single producer and a single consumer,
+        //  which are never blocked: push() and pop() fail instead.
+        template<typename T>
+        class spscQueue
+        {
+        private:
+            std::vector<T> slots;
+            alignas(64) std::atomic<std::size_t> head{ 0 };
+            alignas(64) std::atomic<std::size_t> tail{ 0 };
+        
+        public:
+            explicit spscQueue(std::size_t capacity) :
+                    slots(capacity + 1)
+            {
+            }
+            
+            bool push(T value)
+            {
+                const std::size_t t{ tail.load(std::memory_order_relaxed) };
+                const std::size_t next{ t + 1 == slots.size() ? 0 : t + 1 };
+                
+                if (next == head.load(std::memory_order_acquire))
+                    return false;
+                
+                slots[t] = std::move(value);
+                tail.store(next, std::memory_order_release);
+                return true;
+            }
+            
+            bool pop(T& value)
+            {
+                const std::size_t h{ head.load(std::memory_order_relaxed) };
+                
+                if (h == tail.load(std::memory_order_acquire))
+                    return false;
+                
+                value = std::move(slots[h]);
+                head.store(h + 1 == slots.size() ? 0 : h + 1, std::memory_order_release);
+                return true;
+            }
+            
+            [[nodiscard]]
+            bool empty() const
+            {
+                return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+            }
+            
+            [[nodiscard]]
+            std::size_t size() const
+            {
+                const std::size_t h{ head.load(std::memory_order_acquire) };
+                const std::size_t t{ tail.load(std::memory_order_acquire) };
+                return t >= h ? t - h : t + slots.size() - h;
+            }
+        };
+        
+        struct pipelineBatch
+        {
+            std::vector<std::uint64_t> values;
+            std::size_t rows{ 0 };
+        };
+    }
+    
+    struct pipelineOptions
+    {
+        //  Number of rows passed from one stage to the next at a time.
+        std::size_t batchRows{ 256 };
+        
+        //  Number of batches which can be waiting between two stages.
+        std::size_t queueDepth{ 4 };
+        
+        std::size_t fuel{ std::numeric_limits<std::size_t>::max() };
+        unsigned threads{ 0 };
+    };
+    
+    //  A tree of stages, each executing an image. Stages without an input
+    //  execute the rows given to run(), and the others execute the rows left
+    //  by the stage they are connected to, with the registers mapped as
+    //  given to connect(). A stage can feed any number of others.
+    class pipeline
+    {
+    private:
+        struct edge
+        {
+            std::size_t from;
+            std::size_t to;
+            std::vector<std::pair<std::size_t, std::size_t>> registers;
+        };
+        
+        std::vector<image> stages;
+        std::vector<edge> edges;
+        
+        static constexpr std::size_t none{ std::numeric_limits<std::size_t>::max() };
+    
+    public:
+        //  Adds a stage executing an image, and returns its index.
+        std::size_t add(image p)
+        {
+            p.check();
+            stages.push_back(std::move(p));
+            return stages.size() - 1;
+        }
+        
+        template<std::size_t maxRegisters, std::size_t instrCount>
+        std::size_t add(const program<maxRegisters, instrCount>& p)
+        {
+            return add(image{ p });
+        }
+        
+        //  Feeds the rows left by stage from to stage to, with register
+        //  registers[i].second of each row of to starting with the value of
+        //  register registers[i].first of the row of from, and the others
+        //  with zero. Throws std::invalid_argument if either stage does not
+        //  exist or to already has an input, as each stage has at most one.
+        void connect(std::size_t from, std::size_t to, std::vector<std::pair<std::size_t, std::size_t>> registers)
+        {
+            if (from >= stages.size() || to >= stages.size() || from == to)
+                throw std::invalid_argument("Pipeline Error: no such stage");
+            
+            if (std::any_of(edges.begin(), edges.end(), [to](const edge& e) { return e.to == to; }))
+                throw std::invalid_argument("Pipeline Error: stage already has an input");
+            
+            for (const auto& [output, input] : registers)
+                if (output >= stages[from].registerCount || input >= stages[to].registerCount)
+                    throw std::invalid_argument("Pipeline Error: no such register");
+            
+            edges.push_back({ from, to, std::move(registers) });
+        }
+        
+        [[nodiscard]]
+        std::size_t size() const
+        {
+            return stages.size();
+        }
+        
+        //  Executes the rows of stride registers in values through the
+        //  pipeline, calling sink(stage, rows, width) with each batch of
+        //  rows left by a stage without outputs, where each row has width
+        //  registers. Batches of each stage are passed to the sink in order,
+        //  and the sink is never called concurrently for the same stage.
+        //  Returns totals for each stage. Throws std::length_error if the
+        //  stride is less than the registers of a stage without an input,
+        //  and std::invalid_argument if the stages form a cycle. Exceptions
+        //  thrown by the sink stop the pipeline and are rethrown.
+        template<typename Sink>
+        std::vector<batchStatus> run(std::span<const std::uint64_t> values, std::size_t stride, const Sink& sink,
+                                     pipelineOptions options = {}) const;
+    };
+    
+    template<typename Sink>
+    std::vector<batchStatus> pipeline::run(std::span<const std::uint64_t> values, std::size_t stride, const Sink& sink,
+                                           pipelineOptions options) const
+    {
+        const std::size_t count{ stages.size() };
+        const std::size_t batchRows{ std::max<std::size_t>(options.batchRows, 1) };
+        const std::size_t depth{ std::max<std::size_t>(options.queueDepth, 1) };
+        const std::size_t rows{ stride == 0 ? 0 : values.size() / stride };
+        const trace::span span{ "pipeline", "pipeline" };
+        
+        //  The stages feeding and fed by each stage
+        std::vector<std::size_t> input(count, none);
+        std::vector<std::vector<std::size_t>> outputs(count);
+        
+        for (std::size_t e{ 0 }; e < edges.size(); ++e)
+        {
+            input[edges[e].to] = e;
+            outputs[edges[e].from].push_back(e);
+        }
+        
+        for (std::size_t s{ 0 }; s < count; ++s)
+        {
+            if (input[s] == none && stride < stages[s].registerCount)
+                throw std::length_error("not enough registers for program");
+            
+            //  With one input each, a stage is in a cycle if following its
+            //  inputs back does not reach a stage without one
+            std::size_t at{ s };
+            
+            for (std::size_t i{ 0 }; i <= count && at != none; ++i)
+                at = input[at] == none ? none : edges[input[at]].from;
+            
+            if (at != none)
+                throw std::invalid_argument("Pipeline Error: stages form a cycle");
+        }
+        
+        struct stageState
+        {
+            std::atomic_flag busy;
+            std::atomic<bool> done{ false };
+            std::size_t next{ 0 };
+            impl::pipelineBatch scratch;
+            batchStatus status{ 0, 0, 0 };
+            
+            //  Measured nanoseconds per row, used to run expensive stages
+            //  first when several have batches waiting
+            std::atomic<double> cost{ 1 };
+        };
+        
+        struct edgeState
+        {
+            std::vector<impl::pipelineBatch> batches;
+            impl::spscQueue<impl::pipelineBatch*> full;
+            impl::spscQueue<impl::pipelineBatch*> free;
+            
+            edgeState(std::size_t depth, std::size_t size) :
+                    batches(depth),
+                    full{ depth },
+                    free{ depth }
+            {
+                for (auto& b : batches)
+                {
+                    b.values.resize(size);
+                    free.push(&b);
+                }
+            }
+        };
+        
+        std::vector<stageState> state(count);
+        std::vector<std::unique_ptr<edgeState>> queues;
+        queues.reserve(edges.size());
+        
+        for (const auto& e : edges)
+            queues.push_back(std::make_unique<edgeState>(depth, batchRows * stages[e.to].registerCount));
+        
+        for (std::size_t s{ 0 }; s < count; ++s)
+            if (input[s] == none)
+                state[s].scratch.values.resize(batchRows * stages[s].registerCount);
+        
+        std::atomic<std::size_t> finished{ 0 };
+        std::atomic<bool> failed{ false };
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        
+        //  Executes one batch of a stage, if its input has one and each of
+        //  its outputs has room for one. Only one thread runs a stage at a
+        //  time, which makes it the only consumer of its input queue and the
+        //  only producer of its output queues.
+        const auto step{ [&](std::size_t s) {
+            auto& st{ state[s] };
+            const image& p{ stages[s] };
+            const std::size_t width{ p.registerCount };
+            
+            for (const std::size_t e : outputs[s])
+                if (queues[e]->free.empty())
+                    return false;
+            
+            impl::pipelineBatch* batch{ nullptr };
+            
+            if (input[s] == none)
+            {
+                if (st.next == rows)
+                {
+                    st.done.store(true, std::memory_order_release);
+                    ++finished;
+                    return false;
+                }
+                
+                batch = &st.scratch;
+                batch->rows = std::min(batchRows, rows - st.next);
+                
+                for (std::size_t r{ 0 }; r < batch->rows; ++r)
+                    std::copy_n(values.begin() + static_cast<std::ptrdiff_t>((st.next + r) * stride), width,
+                                batch->values.begin() + static_cast<std::ptrdiff_t>(r * width));
+                
+                st.next += batch->rows;
+            }
+            else
+            {
+                auto& in{ *queues[input[s]] };
+                
+                //  The producer finishes after its last push, so the queue is
+                //  checked once it is known to be done
+                const bool producerDone{ state[edges[input[s]].from].done.load(std::memory_order_acquire) };
+                
+                if (!in.full.pop(batch))
+                {
+                    if (producerDone)
+                    {
+                        st.done.store(true, std::memory_order_release);
+                        ++finished;
+                    }
+                    
+                    return false;
+                }
+            }
+            
+            const auto start{ std::chrono::steady_clock::now() };
+            
+            for (std::size_t r{ 0 }; r < batch->rows; ++r)
+            {
+                const auto result{ impl::execute<std::uint64_t>(p.instructions, p.annotations,
+                                                                std::span{ batch->values }.subspan(r * width, width), 0,
+                                                                options.fuel) };
+                st.status.steps += result.steps;
+                st.status.exhausted += !result.halted;
+            }
+            
+            const std::size_t batchSize{ batch->rows };
+            st.status.runs += batchSize;
+            
+            for (const std::size_t e : outputs[s])
+            {
+                auto& out{ *queues[e] };
+                const std::size_t to{ stages[edges[e].to].registerCount };
+                impl::pipelineBatch* next{ nullptr };
+                out.free.pop(next);
+                
+                std::fill_n(next->values.begin(), batch->rows * to, 0);
+                next->rows = batch->rows;
+                
+                for (std::size_t r{ 0 }; r < batch->rows; ++r)
+                    for (const auto& [output, inputRegister] : edges[e].registers)
+                        next->values[r * to + inputRegister] = batch->values[r * width + output];
+                
+                out.full.push(next);
+            }
+            
+            if (outputs[s].empty())
+                sink(s, std::span<const std::uint64_t>{ batch->values }.first(batch->rows * width), width);
+            
+            //  The batch is reused by the producer once it is returned
+            if (input[s] != none)
+                queues[input[s]]->free.push(batch);
+            
+            const double elapsed{ std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() };
+            st.cost.store(0.75 * st.cost.load(std::memory_order_relaxed) + 0.25 * elapsed / static_cast<double>(batchSize),
+                          std::memory_order_relaxed);
+            return true;
+        } };
+        
+        const auto worker{ [&] {
+            std::vector<std::pair<double, std::size_t>> order(count);
+            
+            try
+            {
+                while (finished.load() < count && !failed.load(std::memory_order_relaxed))
+                {
+                    //  Stages with the most work waiting, weighted by their
+                    //  measured cost, are run first
+                    for (std::size_t s{ 0 }; s < count; ++s)
+                    {
+                        const double waiting{ input[s] == none ? 1.0 : static_cast<double>(queues[input[s]]->full.size()) };
+                        order[s] = { -waiting * state[s].cost.load(std::memory_order_relaxed), count - s };
+                    }
+                    
+                    std::sort(order.begin(), order.end());
+                    bool ran{ false };
+                    
+                    for (const auto& [priority, index] : order)
+                    {
+                        const std::size_t s{ count - index };
+                        
+                        if (state[s].done.load(std::memory_order_acquire) || state[s].busy.test_and_set(std::memory_order_acquire))
+                            continue;
+                        
+                        const bool progressed{ !state[s].done.load(std::memory_order_acquire) && step(s) };
+                        state[s].busy.clear(std::memory_order_release);
+                        
+                        if (progressed)
+                        {
+                            ran = true;
+                            break;
+                        }
+                    }
+                    
+                    if (!ran)
+                        std::this_thread::yield();
+                }
+            }
+            catch (...)
+            {
+                const std::lock_guard lock{ errorMutex };
+                
+                if (!error)
+                    error = std::current_exception();
+                
+                failed = true;
+            }
+        } };
+        
+        if (options.threads == 0)
+            options.threads = std::max(std::thread::hardware_concurrency(), 1u);
+        
+        options.threads = static_cast<unsigned>(std::min<std::size_t>(options.threads, std::max<std::size_t>(count, 1)));
+        
+        if (options.threads <= 1)
+        {
+            worker();
+        }
+        else
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(options.threads);
+            
+            for (unsigned i{ 0 }; i < options.threads; ++i)
+            {
+                workers.emplace_back([&worker, i] {
+                    trace::nameThread("pipeline " + std::to_string(i));
+                    worker();
+                });
+            }
+        }
+        
+        if (error)
+            std::rethrow_exception(error);
+        
+        std::vector<batchStatus> result;
+        result.reserve(count);
+        
+        for (const auto& st : state)
+        {
+            result.push_back(st.status);
+            metrics::add(metrics::PROGRAMS_EXECUTED, st.status.runs);
+            metrics::add(metrics::INSTRUCTIONS_DISPATCHED, st.status.steps);
+            metrics::add(metrics::FUEL_EXHAUSTED, st.status.exhausted);
+        }
+        
+        return result;
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_PIPELINE_HPP
@@ -0,0 +1,678 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_RUNTIME_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_RUNTIME_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../ctrm.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+namespace ctrm
+{
+    namespace impl
+    {
+        //  Executes instructions from the first line, recording metrics and
+        //  a trace span for the execution. Executions which stop without
+        //  halting before running out of fuel were interrupted.
+        template<std::unsigned_integral IntType, std::predicate Interrupt = uninterruptible>
+        status run(std::span<const instruction> instructions, std::span<const annotation> annotations,
+                   std::span<IntType> values, std::size_t fuel, Interrupt interrupted = {})
+        {
+            const metrics::timer timer{ metrics::RUN_DURATION };
+            const trace::span span{ "run", "exec" };
+            const status result{ execute<IntType>(instructions, annotations, values, 0, fuel, interrupted) };
+            
+            metrics::add(metrics::PROGRAMS_EXECUTED);
+            metrics::add(metrics::INSTRUCTIONS_DISPATCHED, result.steps);
+            
+            if (!result.halted)
+                metrics::add(result.steps == fuel ? metrics::FUEL_EXHAUSTED : metrics::EXECUTIONS_CANCELLED);
+            
+            return result;
+        }
+        
+        //  Interrupts an execution once a stop is requested or the deadline
+        //  passes. The clock is only read for executions with a deadline.
+        struct cancellation
+        {
+            const std::stop_token& token;
+            std::chrono::steady_clock::time_point deadline;
+            
+            bool operator()() const
+            {
+                return token.stop_requested()
+                       || (deadline != std::chrono::steady_clock::time_point::max()
+                           && std::chrono::steady_clock::now() >= deadline);
+            }
+        };
+        
+        inline constexpr std::array<char, 4> binaryMagic{ 'C', 'T', 'R', 'M' };
+        inline constexpr std::uint32_t binaryVersion{ 1 };
+        inline constexpr std::size_t binaryHeaderSize{ 24 };
+        inline constexpr std::size_t binaryInstructionSize{ 32 };
+        
+        inline void writeInt(std::byte* out, std::uint64_t value, std::size_t size)
+        {
+            for (std::size_t i{ 0 }; i < size; ++i)
+                out[i] = static_cast<std::byte>(value >> (8 * i));
+        }
+        
+        inline std::uint64_t readInt(const std::byte* in, std::size_t size)
+        {
+            std::uint64_t value{ 0 };
+            
+            for (std::size_t i{ 0 }; i < size; ++i)
+                value |= static_cast<std::uint64_t>(in[i]) << (8 * i);
+            
+            return value;
+        }
+        
+        //  Hashes the fields of every instruction, so that an image can tell
+        //  whether its instructions have changed since they were analysed.
+        inline std::uint64_t fingerprint(std::span<const instruction> instructions)
+        {
+            std::uint64_t hash{ instructions.size() };
+            
+            for (const auto& ins : instructions)
+                for (const std::uint64_t field : { std::uint64_t{ ins.type }, std::uint64_t{ ins.currentRegister },
+                                                   std::uint64_t{ ins.location1 }, std::uint64_t{ ins.location2 } })
+                    hash = (hash ^ field) * 0x9e3779b97f4a7c15;
+            
+            return hash ^ hash >> 32;
+        }
+    }
+    
+    //  A program loaded at run-time, for programs which are not known when
+    //  compiling. Unlike program, the number of registers and instructions
+    //  are not part of the type, so a single instantiation of each engine
+    //  can execute any image.
+    //
+    //  The annotations are derived from the instructions when an image is
+    //  created, and must be updated by calling analyse() after changing the
+    //  instructions of an existing image. The image keeps a fingerprint of
+    //  the instructions it was analysed with, which check() compares against
+    //  the current ones before the image is executed in builds without
+    //  NDEBUG.
+    //
+    //  The instructions and annotations are allocated from a memory resource,
+    //  by default the global one, so that images can be kept in an arena
+    //  (see ctrm/arena.hpp). Copies use the default resource unless another
+    //  is given. As both are std::pmr::vector, a std::vector cannot be
+    //  assigned to them, and must be copied in with assign() instead. Moves
+    //  keep the resource, so an image allocated in a scratch arena and moved
+    //  out of its scratchScope refers to memory which is reused once the
+    //  scope ends; it must be copied out instead.
+    struct image
+    {
+        std::size_t registerCount{ 1 };
+        std::pmr::vector<impl::instruction> instructions;
+        std::pmr::vector<impl::annotation> annotations;
+        
+        image() = default;
+        
+        explicit image(std::pmr::memory_resource* resource) :
+                instructions(resource),
+                annotations(resource)
+        {
+        }
+        
+        image(const image& other, std::pmr::memory_resource* resource) :
+                registerCount{ other.registerCount },
+                instructions(other.instructions, resource),
+                annotations(other.annotations, resource),
+                analysed{ other.analysed }
+        {
+        }
+        
+        template<std::size_t maxRegisters, std::size_t instrCount>
+        [[maybe_unused]]
+        explicit image(const program<maxRegisters, instrCount>& p,
+                       std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+                registerCount{ std::max<std::size_t>(maxRegisters, 1) },
+                instructions(p.instructions.begin(), p.instructions.end(), resource),
+                annotations(p.annotations.begin(), p.annotations.end(), resource),
+                analysed{ impl::fingerprint(instructions) }
+        {
+        }
+        
+        void analyse()
+        {
+            annotations.resize(instructions.size());
+            impl::annotate(instructions, annotations);
+            analysed = impl::fingerprint(instructions);
+        }
+        
+        //  Throws std::invalid_argument if the instructions have been changed
+        //  without calling analyse(). With NDEBUG, only a change in the
+        //  number of instructions is detected, so that the check takes
+        //  constant time; otherwise it takes time linear in the number of
+        //  instructions, as assert() would.
+        void check() const
+        {
+            if (annotations.size() != instructions.size())
+                throw std::invalid_argument("Image Error: image was modified without being analysed");
+            
+#ifndef NDEBUG
+            if (analysed != impl::fingerprint(instructions))
+                throw std::invalid_argument("Image Error: image was modified without being analysed");
+#endif
+        }
+        
+    private:
+        std::uint64_t analysed{ impl::fingerprint({}) };
+    };
+    
+    //  Creates an image from a program in the text format at run-time. The
+    //  number of registers and instructions are calculated from the program.
+    //  Throws std::invalid_argument if the program contains syntax errors.
+    [[maybe_unused]] [[nodiscard]]
+    inline image load(std::string_view text, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    {
+        image result{ resource };
+        const parser<std::dynamic_extent> p{ text };
+        
+        p.parseStatements(std::dynamic_extent, [&](std::size_t, const impl::instruction& ins) {
+            if (ins.type != impl::HALT)
+                result.registerCount = std::max(result.registerCount, ins.currentRegister + 1);
+            
+            result.instructions.push_back(ins);
+        });
+        
+        result.analyse();
+        return result;
+    }
+    
+    //  Creates an image from the binary format written by saveBinary().
+    //  Throws std::invalid_argument if the data is not a valid image.
+    [[maybe_unused]] [[nodiscard]]
+    inline image loadBinary(std::span<const std::byte> data,
+                            std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+    {
+        if (data.size() < impl::binaryHeaderSize
+            || !std::equal(impl::binaryMagic.begin(), impl::binaryMagic.end(), data.begin(),
+                           [](char c, std::byte b) { return static_cast<std::byte>(c) == b; })
+            || impl::readInt(data.data() + 4, 4) != impl::binaryVersion)
+            throw std::invalid_argument("Image Error: missing or unsupported image header");
+        
+        image result{ resource };
+        result.registerCount = impl::readInt(data.data() + 8, 8);
+        const std::uint64_t instrCount{ impl::readInt(data.data() + 16, 8) };
+        
+        if (result.registerCount == 0
+            || instrCount > (data.size() - impl::binaryHeaderSize) / impl::binaryInstructionSize)
+            throw std::invalid_argument("Image Error: image is truncated or corrupt");
+        
+        result.instructions.reserve(instrCount);
+        
+        for (std::size_t i{ 0 }; i < instrCount; ++i)
+        {
+            const std::byte* in{ data.data() + impl::binaryHeaderSize + i * impl::binaryInstructionSize };
+            const auto type{ impl::readInt(in, 8) };
+            const auto reg{ impl::readInt(in + 8, 8) };
+            
+            if (type > impl::DECR || (type != impl::HALT && reg >= result.registerCount))
+                throw std::invalid_argument("Image Error: image contains an invalid instruction");
+            
+            if (type == impl::HALT)
+                result.instructions.emplace_back();
+            else if (type == impl::INCR)
+                result.instructions.emplace_back(reg, impl::readInt(in + 16, 8));
+            else
+                result.instructions.emplace_back(reg, impl::readInt(in + 16, 8), impl::readInt(in + 24, 8));
+        }
+        
+        result.analyse();
+        return result;
+    }
+    
+    //  Writes an image in a compact binary format which can be loaded
+    //  without parsing. Returns the size of the image in bytes; nothing is
+    //  written if out is smaller than this.
+    [[maybe_unused]]
+    inline std::size_t saveBinary(const image& p, std::span<std::byte> out)
+    {
+        const std::size_t size{ impl::binaryHeaderSize + p.instructions.size() * impl::binaryInstructionSize };
+        
+        if (out.size() < size)
+            return size;
+        
+        std::transform(impl::binaryMagic.begin(), impl::binaryMagic.end(), out.begin(),
+                       [](char c) { return static_cast<std::byte>(c); });
+        impl::writeInt(out.data() + 4, impl::binaryVersion, 4);
+        impl::writeInt(out.data() + 8, p.registerCount, 8);
+        impl::writeInt(out.data() + 16, p.instructions.size(), 8);
+        
+        for (std::size_t i{ 0 }; i < p.instructions.size(); ++i)
+        {
+            const auto& ins{ p.instructions[i] };
+            std::byte* o{ out.data() + impl::binaryHeaderSize + i * impl::binaryInstructionSize };
+            impl::writeInt(o, ins.type, 8);
+            impl::writeInt(o + 8, ins.currentRegister, 8);
+            impl::writeInt(o + 16, ins.location1, 8);
+            impl::writeInt(o + 24, ins.location2, 8);
+        }
+        
+        return size;
+    }
+    
+    //  Run-time counterpart of program.stats(): describes the structure of
+    //  an image.
+    [[maybe_unused]] [[nodiscard]]
+    inline statistics stats(const image& p)
+    {
+        return impl::measure(p.instructions, p.registerCount);
+    }
+    
+    namespace metrics
+    {
+        //  Exports the statistics of a program with the other metrics, as
+        //  gauges labelled with the given name.
+        inline void describe(std::string_view program, const statistics& s)
+        {
+            describe(program, { s.instructions, s.increments, s.decrements, s.halts, s.registers, s.reachable,
+                                s.loops, s.loopDepth, s.largestComponent, static_cast<std::uint64_t>(s.cost) });
+        }
+    }
+    
+    //  Executes a program at run-time on the registers in values, stopping
+    //  once the program halts or after fuel instructions have been executed.
+    //  The registers are left in their final state.
+    template<std::unsigned_integral IntType, std::size_t maxRegisters, std::size_t instrCount>
+    [[maybe_unused]]
+    status run(const program<maxRegisters, instrCount>& p, std::span<IntType, maxRegisters> values,
+               std::size_t fuel = std::numeric_limits<std::size_t>::max())
+    {
+        return impl::run<IntType>(p.instructions, p.annotations, values, fuel);
+    }
+    
+    //  Executes an image on the registers in values as above. Throws
+    //  std::length_error if there are fewer values than registers, and
+    //  std::invalid_argument if the image has not been analysed.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]]
+    status run(const image& p, std::span<IntType> values, std::size_t fuel = std::numeric_limits<std::size_t>::max())
+    {
+        if (values.size() < p.registerCount)
+            throw std::length_error("not enough registers for program");
+        
+        p.check();
+        return impl::run<IntType>(p.instructions, p.annotations, values, fuel);
+    }
+    
+    //  Describes where a cancellable execution stopped. Executions which are
+    //  cancelled, or reach their deadline, stop with their registers in the
+    //  state reached so far and have not halted.
+    struct cancellableStatus : status
+    {
+        bool cancelled;
+    };
+    
+    //  Executes a program on the registers in values as above, also stopping
+    //  once a stop is requested through token or the deadline passes. These
+    //  are checked every impl::pollInterval instructions, which takes
+    //  microseconds, rather than on every instruction (see the cancellation
+    //  benchmark).
+    template<std::unsigned_integral IntType, std::size_t maxRegisters, std::size_t instrCount>
+    [[maybe_unused]]
+    cancellableStatus run(const program<maxRegisters, instrCount>& p, std::span<IntType, maxRegisters> values,
+                          const std::stop_token& token,
+                          std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+                          std::size_t fuel = std::numeric_limits<std::size_t>::max())
+    {
+        const status s{ impl::run<IntType>(p.instructions, p.annotations, values, fuel,
+                                           impl::cancellation{ token, deadline }) };
+        return { s, !s.halted && s.steps != fuel };
+    }
+    
+    //  Executes an image on the registers in values until it halts, runs out
+    //  of fuel, a stop is requested through token or the deadline passes, as
+    //  above.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]]
+    cancellableStatus run(const image& p, std::span<IntType> values, const std::stop_token& token,
+                          std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+                          std::size_t fuel = std::numeric_limits<std::size_t>::max())
+    {
+        if (values.size() < p.registerCount)
+            throw std::length_error("not enough registers for program");
+        
+        p.check();
+        const status s{ impl::run<IntType>(p.instructions, p.annotations, values, fuel,
+                                           impl::cancellation{ token, deadline }) };
+        return { s, !s.halted && s.steps != fuel };
+    }
+    
+    //  Executes an image on the registers in values until it halts, runs out
+    //  of fuel or the deadline passes.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]]
+    cancellableStatus run(const image& p, std::span<IntType> values, std::chrono::steady_clock::time_point deadline,
+                          std::size_t fuel = std::numeric_limits<std::size_t>::max())
+    {
+        return run<IntType>(p, values, std::stop_token{}, deadline, fuel);
+    }
+    
+    //  Totals over every execution in a batch.
+    struct batchStatus
+    {
+        std::size_t runs;
+        std::size_t steps;
+        std::size_t exhausted;
+    };
+    
+    //  Options for runBatch().
+    struct batchOptions
+    {
+        std::size_t fuel{ std::numeric_limits<std::size_t>::max() };
+        
+        //  By default, one thread for each hardware thread.
+        unsigned threads{ 0 };
+        
+        //  Executes rows with the same registers only once, and copies the
+        //  result to the others. Only the registers used by the program are
+        //  compared and copied, and the rest of each row is left alone.
+        bool deduplicate{ false };
+        
+        //  Executes the rows predicted to take the most steps first, so that
+        //  threads do not finish the batch one at a time on expensive rows.
+        //  Steps are predicted from the cost class of the program and the
+        //  registers of each row (see impl::predictSteps()).
+        bool costOrder{ false };
+    };
+    
+    namespace impl
+    {
+        template<std::unsigned_integral IntType>
+        std::uint64_t hashRow(const IntType* row, std::size_t count)
+        {
+            std::uint64_t hash{ count };
+            
+            for (std::size_t i{ 0 }; i < count; ++i)
+                hash = (hash ^ static_cast<std::uint64_t>(row[i])) * 0x9e3779b97f4a7c15;
+            
+            return hash ^ hash >> 32;
+        }
+        
+        //  Finds the rows with distinct registers, with an open addressing
+        //  table of row indices. Returns the first row with each set of
+        //  registers, along with the number of rows which have them, and the
+        //  index in the result of the registers of every row.
+        template<std::unsigned_integral IntType>
+        std::vector<std::size_t> distinctRows(std::span<const IntType> values, std::size_t stride, std::size_t registers,
+                                              std::vector<std::size_t>& group, std::vector<std::size_t>& copies)
+        {
+            constexpr std::size_t empty{ std::numeric_limits<std::size_t>::max() };
+            const std::size_t rows{ values.size() / stride };
+            const std::size_t mask{ std::bit_ceil(rows * 2 + 1) - 1 };
+            std::vector<std::size_t> table(mask + 1, empty);
+            std::vector<std::size_t> distinct;
+            
+            group.resize(rows);
+            copies.clear();
+            
+            for (std::size_t row{ 0 }; row < rows; ++row)
+            {
+                const IntType* current{ values.data() + row * stride };
+                std::size_t slot{ hashRow(current, registers) & mask };
+                
+                while (table[slot] != empty
+                       && !std::equal(current, current + registers, values.data() + table[slot] * stride))
+                    slot = (slot + 1) & mask;
+                
+                if (table[slot] == empty)
+                {
+                    table[slot] = row;
+                    group[row] = distinct.size();
+                    distinct.push_back(row);
+                    copies.push_back(1);
+                }
+                else
+                {
+                    group[row] = group[table[slot]];
+                    ++copies[group[row]];
+                }
+            }
+            
+            return distinct;
+        }
+        
+        //  A cheap prediction of the number of steps taken by a row, for
+        //  ordering rows rather than as an estimate: the sum of the registers
+        //  for programs of linear cost, and the product of one more than each
+        //  for more expensive programs, saturating. Loops which are executed
+        //  in constant time make every prediction an overestimate.
+        template<std::unsigned_integral IntType>
+        std::uint64_t predictSteps(costClass cost, const IntType* row, std::size_t registers)
+        {
+            constexpr std::uint64_t max{ std::numeric_limits<std::uint64_t>::max() };
+            std::uint64_t result{ cost == LINEAR ? 0u : 1u };
+            
+            for (std::size_t i{ 0 }; cost != CONSTANT && i < registers; ++i)
+            {
+                const std::uint64_t value{ row[i] };
+                
+                if (cost == LINEAR)
+                    result = value > max - result ? max : result + value;
+                else
+                    result = value == max || result > max / (value + 1) ? max : result * (value + 1);
+            }
+            
+            return result;
+        }
+    }
+    
+    //  Executes an image once for each row of stride registers in values,
+    //  in parallel on the given number of threads. Rows are handed out to
+    //  threads in chunks as they become free, so that expensive rows do not
+    //  hold up other threads; when the rows are ordered by cost, chunks start
+    //  with a single row and grow as the rows get cheaper. The status counts
+    //  every row, including those copied from another.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]]
+    batchStatus runBatch(const image& p, std::span<IntType> values, std::size_t stride, const batchOptions& options)
+    {
+        if (stride < p.registerCount)
+            throw std::length_error("not enough registers for program");
+        
+        p.check();
+        constexpr std::size_t chunk{ 256 };
+        const std::size_t rows{ values.size() / stride };
+        const trace::span span{ "batch", "batch" };
+        
+        //  Rows in the order they are executed, and the number of rows
+        //  each stands for, unless every row is executed in turn
+        std::vector<std::size_t> order;
+        std::vector<std::size_t> copies;
+        std::vector<std::size_t> group;
+        
+        if (options.deduplicate)
+        {
+            order = impl::distinctRows<IntType>(values, stride, p.registerCount, group, copies);
+        }
+        else if (options.costOrder)
+        {
+            order.resize(rows);
+            std::iota(order.begin(), order.end(), std::size_t{ 0 });
+        }
+        
+        if (options.costOrder)
+        {
+            const costClass cost{ stats(p).cost };
+            std::vector<std::uint64_t> predictions(order.size());
+            std::vector<std::size_t> positions(order.size());
+            
+            for (std::size_t i{ 0 }; i < order.size(); ++i)
+                predictions[i] = impl::predictSteps(cost, values.data() + order[i] * stride, p.registerCount);
+            
+            std::iota(positions.begin(), positions.end(), std::size_t{ 0 });
+            std::stable_sort(positions.begin(), positions.end(),
+                             [&](std::size_t a, std::size_t b) { return predictions[a] > predictions[b]; });
+            
+            std::vector<std::size_t> sorted(order.size());
+            std::vector<std::size_t> sortedCopies(copies.size());
+            
+            for (std::size_t i{ 0 }; i < order.size(); ++i)
+            {
+                sorted[i] = order[positions[i]];
+                
+                if (!copies.empty())
+                    sortedCopies[i] = copies[positions[i]];
+            }
+            
+            order = std::move(sorted);
+            copies = std::move(sortedCopies);
+        }
+        
+        const std::size_t count{ order.empty() ? rows : order.size() };
+        std::atomic<std::size_t> next{ 0 };
+        std::atomic<std::size_t> steps{ 0 };
+        std::atomic<std::size_t> exhausted{ 0 };
+        unsigned threads{ options.threads };
+        
+        if (threads == 0)
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        
+        //  Claims the next chunk of rows, returning false once there are none
+        const auto claim{ [&](std::size_t& begin, std::size_t& end) {
+            begin = next.load(std::memory_order_relaxed);
+            
+            do
+            {
+                if (begin >= count)
+                    return false;
+                
+                const std::size_t size{ options.costOrder ? std::min(chunk, begin / (4 * threads) + 1) : chunk };
+                end = std::min(begin + size, count);
+            }
+            while (!next.compare_exchange_weak(begin, end, std::memory_order_relaxed));
+            
+            return true;
+        } };
+        
+        const auto worker{ [&] {
+            std::size_t localSteps{ 0 };
+            std::size_t localExhausted{ 0 };
+            
+            for (std::size_t begin, end; claim(begin, end);)
+            {
+                const trace::span task{ "task", "batch" };
+                
+                for (std::size_t i{ begin }; i < end; ++i)
+                {
+                    const std::size_t row{ order.empty() ? i : order[i] };
+                    const std::size_t n{ copies.empty() ? 1 : copies[i] };
+                    const auto s{ impl::execute<IntType>(p.instructions, p.annotations, values.subspan(row * stride, stride), 0,
+                                                          options.fuel) };
+                    localSteps += s.steps * n;
+                    localExhausted += s.halted ? 0 : n;
+                }
+            }
+            
+            steps += localSteps;
+            exhausted += localExhausted;
+        } };
+        
+        const std::size_t chunks{ options.costOrder ? count : (count + chunk - 1) / chunk };
+        threads = static_cast<unsigned>(std::min<std::size_t>(threads, chunks));
+        
+        if (threads <= 1)
+        {
+            worker();
+        }
+        else
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(threads);
+            
+            for (unsigned i{ 0 }; i < threads; ++i)
+            {
+                workers.emplace_back([&worker, i] {
+                    trace::nameThread("worker " + std::to_string(i));
+                    worker();
+                });
+            }
+        }
+        
+        //  Copy the registers of each distinct row to the rows the same as it
+        if (options.deduplicate)
+        {
+            std::vector<std::size_t> distinct(copies.size());
+            
+            for (const std::size_t row : order)
+                distinct[group[row]] = row;
+            
+            for (std::size_t row{ 0 }; row < rows; ++row)
+            {
+                const std::size_t from{ distinct[group[row]] };
+                
+                if (from != row)
+                    std::copy_n(values.data() + from * stride, p.registerCount, values.data() + row * stride);
+            }
+        }
+        
+        metrics::add(metrics::PROGRAMS_EXECUTED, rows);
+        metrics::add(metrics::INSTRUCTIONS_DISPATCHED, steps);
+        metrics::add(metrics::FUEL_EXHAUSTED, exhausted);
+        
+        return { rows, steps, exhausted };
+    }
+    
+    //  Executes an image once for each row of stride registers in values,
+    //  in parallel on the given number of threads (by default one for each
+    //  hardware thread), as above.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]]
+    batchStatus runBatch(const image& p, std::span<IntType> values, std::size_t stride,
+                         std::size_t fuel = std::numeric_limits<std::size_t>::max(), unsigned threads = 0)
+    {
+        return runBatch<IntType>(p, values, stride, batchOptions{ fuel, threads });
+    }
+    
+    //  Run-time counterpart of program.exec(): executes a program with the
+    //  arguments as the initial values of the first registers and returns
+    //  the value in the first register once the program halts.
+    template<std::unsigned_integral IntType = std::size_t, std::size_t maxRegisters, std::size_t instrCount,
+             typename... Args>
+    requires ((sizeof...(Args) <= maxRegisters) && ... && std::convertible_to<Args, IntType>)
+    [[maybe_unused]] [[nodiscard]]
+    IntType run(const program<maxRegisters, instrCount>& p, Args... args)
+    {
+        std::array<IntType, maxRegisters> values{ static_cast<IntType>(args)... };
+        run<IntType>(p, std::span<IntType, maxRegisters>{ values });
+        return values[0];
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_RUNTIME_HPP
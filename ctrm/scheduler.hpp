@@ -0,0 +1,323 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_SCHEDULER_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_SCHEDULER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <utility>
+#include <vector>
+
+#include "runtime.hpp"
+
+//  Shares the threads executing programs between tenants. Executions are
+//  run in time slices, so that an expensive execution holds a thread for no
+//  longer than a slice, and each slice goes to the tenant which has had the
+//  fewest steps executed for it relative to its weight. Within a tenant, the
+//  execution with the earliest deadline runs first.
+namespace ctrm
+{
+    struct tenantOptions
+    {
+        //  Share of the steps executed, relative to the other tenants.
+        double weight{ 1 };
+        
+        //  Executions which can be waiting at once; more are rejected.
+        std::size_t maxQueued{ 1024 };
+        
+        //  Most expensive programs admitted, by the cost class of their
+        //  statistics (see ctrm::stats()).
+        costClass maxCost{ POLYNOMIAL };
+        
+        //  Fuel given to each execution at most.
+        std::size_t maxFuel{ std::numeric_limits<std::size_t>::max() };
+    };
+    
+    enum jobState
+    {
+        COMPLETED,
+        EXHAUSTED,
+        EXPIRED,
+        REJECTED,
+    };
+    
+    //  The final registers of an execution, or those it had reached when it
+    //  ran out of fuel or time.
+    struct jobResult
+    {
+        jobState state;
+        std::vector<std::uint64_t> registers;
+        status execution;
+    };
+    
+    class scheduler
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+        
+        //  Executions run for about a slice at a time (and no more than one
+        //  slice past their deadlines).
+        explicit scheduler(clock::duration slice = std::chrono::milliseconds{ 1 }) :
+                slice{ slice }
+        {
+        }
+        
+        //  Adds a tenant, and returns its index.
+        std::size_t addTenant(tenantOptions options = {})
+        {
+            if (!(options.weight > 0))
+                throw std::invalid_argument("Scheduler Error: weights must be positive");
+            
+            const std::lock_guard lock{ mutex };
+            tenants.push_back({ options, {}, 0 });
+            return tenants.size() - 1;
+        }
+        
+        //  Queues an execution of an image for a tenant, from the given
+        //  registers. The result is REJECTED at once if the tenant's queue is
+        //  full, the program is more expensive than the tenant admits, or
+        //  the deadline has passed, and EXPIRED if the deadline passes before
+        //  the program halts. Throws std::length_error if there are fewer
+        //  registers than the image uses. The cost class of an image is
+        //  measured on its first submission only.
+        std::future<jobResult> submit(std::size_t tenant, std::shared_ptr<const image> p,
+                                      std::vector<std::uint64_t> registers,
+                                      std::size_t fuel = std::numeric_limits<std::size_t>::max(),
+                                      clock::time_point deadline = clock::time_point::max())
+        {
+            if (registers.size() < p->registerCount)
+                throw std::length_error("not enough registers for program");
+            
+            p->check();
+            const costClass cost{ costOf(p) };
+            std::promise<jobResult> promise;
+            auto future{ promise.get_future() };
+            
+            {
+                const std::lock_guard lock{ mutex };
+                auto& t{ tenants.at(tenant) };
+                
+                if (t.queue.size() < t.options.maxQueued && cost <= t.options.maxCost && clock::now() < deadline)
+                {
+                    //  A tenant which was idle starts level with the others,
+                    //  rather than with the share it did not use
+                    if (t.queue.empty())
+                        t.used = std::max(t.used, floor());
+                    
+                    t.queue.push_back({ std::move(p), std::move(registers), std::move(promise), deadline,
+                                        std::min(fuel, t.options.maxFuel), 0, 0 });
+                    std::push_heap(t.queue.begin(), t.queue.end(), later);
+                    ++queued;
+                    ready.notify_one();
+                    return future;
+                }
+            }
+            
+            promise.set_value({ REJECTED, std::move(registers), { 0, 0, false } });
+            return future;
+        }
+        
+        //  Runs one slice, if any execution is waiting, and returns whether
+        //  one was.
+        bool runSlice()
+        {
+            std::unique_lock lock{ mutex };
+            return runSlice(lock);
+        }
+        
+        //  Runs slices on the calling thread until a stop is requested,
+        //  waiting while no execution is waiting. Any number of threads can
+        //  serve the same scheduler.
+        void serve(std::stop_token stop)
+        {
+            std::unique_lock lock{ mutex };
+            
+            while (!stop.stop_requested())
+                if (!runSlice(lock))
+                    ready.wait(lock, stop, [this] { return queued != 0; });
+        }
+        
+        //  Steps executed for a tenant, divided by its weight.
+        [[nodiscard]]
+        double usage(std::size_t tenant) const
+        {
+            const std::lock_guard lock{ mutex };
+            return tenants.at(tenant).used;
+        }
+    
+    private:
+        struct job
+        {
+            std::shared_ptr<const image> program;
+            std::vector<std::uint64_t> registers;
+            std::promise<jobResult> promise;
+            clock::time_point deadline;
+            std::size_t fuel;
+            std::size_t location;
+            std::size_t steps;
+        };
+        
+        struct tenant
+        {
+            tenantOptions options;
+            
+            //  A heap ordered by deadline
+            std::vector<job> queue;
+            double used;
+        };
+        
+        clock::duration slice;
+        
+        //  Steps executed between checks of the clock start at firstChunk,
+        //  and double after each check, as loops executed in constant time
+        //  can take any number of steps
+        static constexpr std::size_t firstChunk{ 1024 };
+        std::vector<tenant> tenants;
+        std::size_t queued{ 0 };
+        
+        //  Cost classes of the images submitted, until they are destroyed
+        std::map<std::weak_ptr<const image>, costClass, std::owner_less<>> costs;
+        mutable std::mutex mutex;
+        std::condition_variable_any ready;
+        
+        static bool later(const job& a, const job& b)
+        {
+            return a.deadline > b.deadline;
+        }
+        
+        //  The cost class of an image, measured without holding the lock when
+        //  it is first submitted. Entries for images which no longer exist
+        //  are dropped as new images are added.
+        costClass costOf(const std::shared_ptr<const image>& p)
+        {
+            {
+                const std::lock_guard lock{ mutex };
+                
+                if (const auto i{ costs.find(p) }; i != costs.end())
+                    return i->second;
+            }
+            
+            const costClass cost{ stats(*p).cost };
+            const std::lock_guard lock{ mutex };
+            std::erase_if(costs, [](const auto& c) { return c.first.expired(); });
+            costs.emplace(p, cost);
+            return cost;
+        }
+        
+        //  The least usage of the tenants with executions waiting.
+        double floor() const
+        {
+            double result{ std::numeric_limits<double>::max() };
+            
+            for (const auto& t : tenants)
+                if (!t.queue.empty())
+                    result = std::min(result, t.used);
+            
+            return result == std::numeric_limits<double>::max() ? 0 : result;
+        }
+        
+        bool runSlice(std::unique_lock<std::mutex>& lock)
+        {
+            tenant* next{ nullptr };
+            
+            for (auto& t : tenants)
+                if (!t.queue.empty() && (next == nullptr || t.used < next->used))
+                    next = &t;
+            
+            if (next == nullptr)
+                return false;
+            
+            std::pop_heap(next->queue.begin(), next->queue.end(), later);
+            job j{ std::move(next->queue.back()) };
+            next->queue.pop_back();
+            --queued;
+            
+            const std::size_t index{ static_cast<std::size_t>(next - tenants.data()) };
+            lock.unlock();
+            
+            //  Executions whose deadline has passed while waiting expire
+            //  without being run, and those at a HALT have halted even
+            //  without fuel left
+            const auto start{ clock::now() };
+            const auto end{ std::min(j.deadline, start + slice) };
+            const auto& code{ j.program->instructions };
+            status s{ j.location, 0, j.location >= code.size() || code[j.location].type == impl::HALT };
+            bool expired{ start >= j.deadline };
+            
+            for (std::size_t chunk{ firstChunk }; !s.halted && !expired && j.steps + s.steps < j.fuel;
+                 chunk = std::min(chunk, std::numeric_limits<std::size_t>::max() / 2) * 2)
+            {
+                const status next{ impl::execute<std::uint64_t>(j.program->instructions, j.program->annotations,
+                                                                j.registers, s.location,
+                                                                std::min(chunk, j.fuel - j.steps - s.steps)) };
+                s = { next.location, s.steps + next.steps, next.halted };
+                
+                if (s.halted)
+                    break;
+                
+                const auto now{ clock::now() };
+                expired = now >= j.deadline;
+                
+                if (now >= end)
+                    break;
+            }
+            
+            j.location = s.location;
+            j.steps += s.steps;
+            metrics::add(metrics::INSTRUCTIONS_DISPATCHED, s.steps);
+            
+            const bool exhausted{ !s.halted && j.steps == j.fuel };
+            
+            if (s.halted || expired || exhausted)
+            {
+                metrics::add(metrics::PROGRAMS_EXECUTED);
+                
+                if (exhausted)
+                    metrics::add(metrics::FUEL_EXHAUSTED);
+                
+                j.promise.set_value({ s.halted ? COMPLETED : expired ? EXPIRED : EXHAUSTED, std::move(j.registers),
+                                      { j.location, j.steps, s.halted } });
+            }
+            
+            lock.lock();
+            auto& t{ tenants[index] };
+            
+            //  Every slice counts as at least one step, so that programs
+            //  which halt at once are not free
+            t.used += static_cast<double>(std::max<std::size_t>(s.steps, 1)) / t.options.weight;
+            
+            if (!s.halted && !expired && !exhausted)
+            {
+                t.queue.push_back(std::move(j));
+                std::push_heap(t.queue.begin(), t.queue.end(), later);
+                ++queued;
+            }
+            
+            return true;
+        }
+    };
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_SCHEDULER_HPP
@@ -0,0 +1,381 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_SEARCH_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_SEARCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "runtime.hpp"
+
+//  Inverse questions about a program: the first input in an ordered domain
+//  whose final registers satisfy a predicate, such as the smallest x with
+//  f(x) == y, or every such input. Candidates are executed in parallel, and
+//  the search stops as soon as no earlier candidate can match.
+namespace ctrm
+{
+    //  Every combination of values of some registers, each between a lower
+    //  and upper bound (inclusive), ordered with the first register the most
+    //  significant. The other registers start with the values in base, or
+    //  zero.
+    struct searchDomain
+    {
+        std::vector<std::size_t> registers;
+        std::vector<std::uint64_t> lower;
+        std::vector<std::uint64_t> upper;
+        std::vector<std::uint64_t> base;
+        
+        //  Throws std::invalid_argument if the bounds do not match the
+        //  registers, and std::overflow_error if there are more than 2^64 - 1
+        //  candidates.
+        [[nodiscard]]
+        std::uint64_t size() const
+        {
+            if (lower.size() != registers.size() || upper.size() != registers.size())
+                throw std::invalid_argument("Search Error: bounds do not match the registers");
+            
+            std::uint64_t result{ 1 };
+            
+            for (std::size_t i{ 0 }; i < registers.size(); ++i)
+            {
+                if (upper[i] < lower[i])
+                    return 0;
+                
+                const std::uint64_t range{ upper[i] - lower[i] + 1 };
+                
+                if (range == 0 || result > std::numeric_limits<std::uint64_t>::max() / range)
+                    throw std::overflow_error("Search Error: domain is too large");
+                
+                result *= range;
+            }
+            
+            return result;
+        }
+        
+        //  Sets the registers of the candidate at the given index.
+        template<std::unsigned_integral IntType>
+        void point(std::uint64_t index, std::span<IntType> values) const
+        {
+            std::fill(values.begin(), values.end(), 0);
+            
+            for (std::size_t i{ 0 }; i < base.size() && i < values.size(); ++i)
+                values[i] = static_cast<IntType>(base[i]);
+            
+            for (std::size_t i{ registers.size() }; i-- > 0;)
+            {
+                const std::uint64_t range{ upper[i] - lower[i] + 1 };
+                values[registers[i]] = static_cast<IntType>(lower[i] + index % range);
+                index /= range;
+            }
+        }
+    };
+    
+    struct searchOptions
+    {
+        std::size_t fuel{ std::numeric_limits<std::size_t>::max() };
+        
+        //  Number of threads, or zero for one for each hardware thread.
+        unsigned threads{ 0 };
+        
+        //  Candidates handed to a thread at a time.
+        std::size_t chunk{ 64 };
+        
+        //  Hint that the predicate is false up to some candidate and true
+        //  from then on, so that findFirst() can search by bisection.
+        bool monotone{ false };
+    };
+    
+    //  The first matching candidate, if any, along with the number of
+    //  candidates executed and those which ran out of fuel. Candidates which
+    //  run out of fuel never match.
+    struct searchStatus
+    {
+        std::optional<std::uint64_t> match;
+        std::size_t evaluated;
+        std::size_t exhausted;
+    };
+    
+    struct searchResults
+    {
+        std::vector<std::uint64_t> matches;
+        std::size_t evaluated;
+        std::size_t exhausted;
+    };
+    
+    namespace impl
+    {
+        //  Calls work(thread) on the given number of threads.
+        template<typename Work>
+        void parallel(unsigned threads, const Work& work)
+        {
+            if (threads <= 1)
+            {
+                work(0u);
+                return;
+            }
+            
+            std::vector<std::jthread> workers;
+            workers.reserve(threads);
+            
+            for (unsigned i{ 0 }; i < threads; ++i)
+            {
+                workers.emplace_back([&work, i] {
+                    trace::nameThread("search " + std::to_string(i));
+                    work(i);
+                });
+            }
+        }
+        
+        inline unsigned searchThreads(unsigned threads, std::uint64_t candidates, std::size_t chunk)
+        {
+            if (threads == 0)
+                threads = std::max(std::thread::hardware_concurrency(), 1u);
+            
+            return static_cast<unsigned>(std::max<std::uint64_t>(std::min<std::uint64_t>(threads, (candidates + chunk - 1) / chunk), 1));
+        }
+        
+        //  Executes a candidate in values, returning whether it matches. The
+        //  steps executed are added to steps.
+        template<std::unsigned_integral IntType, typename Predicate>
+        bool candidate(const image& p, const searchDomain& domain, std::uint64_t index, std::span<IntType> values,
+                       const Predicate& predicate, std::size_t fuel, std::size_t& exhausted, std::size_t& steps)
+        {
+            domain.point(index, values);
+            const status s{ execute<IntType>(p.instructions, p.annotations, values, 0, fuel) };
+            steps += s.steps;
+            
+            if (!s.halted)
+            {
+                ++exhausted;
+                return false;
+            }
+            
+            return predicate(std::span<const IntType>{ values });
+        }
+        
+        inline std::size_t searchRegisters(const image& p, const searchDomain& domain)
+        {
+            std::size_t count{ std::max(p.registerCount, domain.base.size()) };
+            
+            for (const std::size_t reg : domain.registers)
+                count = std::max(count, reg + 1);
+            
+            return count;
+        }
+    }
+    
+    //  Finds the first candidate in a domain for which predicate(values) is
+    //  true of the final registers of the image. Threads take chunks of
+    //  candidates in order, and once a match is found, chunks after it are
+    //  skipped. With options.monotone, the domain is instead bisected, by
+    //  executing one candidate on each thread at evenly spaced points.
+    template<std::unsigned_integral IntType, typename Predicate>
+    [[maybe_unused]] [[nodiscard]]
+    searchStatus findFirst(const image& p, const searchDomain& domain, const Predicate& predicate,
+                           searchOptions options = {})
+    {
+        p.check();
+        const std::uint64_t size{ domain.size() };
+        const std::size_t width{ impl::searchRegisters(p, domain) };
+        const std::size_t chunk{ std::max<std::size_t>(options.chunk, 1) };
+        const trace::span span{ "search", "search" };
+        
+        std::atomic<std::uint64_t> best{ size };
+        std::atomic<std::size_t> evaluated{ 0 };
+        std::atomic<std::size_t> exhausted{ 0 };
+        std::atomic<std::size_t> steps{ 0 };
+        
+        if (options.monotone)
+        {
+            //  The first match is in [low, high], where high = size means
+            //  that there is none. Each round probes points dividing the
+            //  range evenly, with one point (the middle) on one thread
+            const unsigned threads{ impl::searchThreads(options.threads, size, 1) };
+            std::vector<std::uint64_t> probes(threads);
+            std::vector<std::uint8_t> matched(threads);
+            std::uint64_t low{ 0 };
+            std::uint64_t high{ size };
+            
+            while (low < high)
+            {
+                const std::uint64_t gap{ high - low };
+                const unsigned count{ static_cast<unsigned>(std::min<std::uint64_t>(threads, gap)) };
+                
+                for (unsigned i{ 0 }; i < count; ++i)
+                    probes[i] = low + gap / (count + 1) * (i + 1) + gap % (count + 1) * (i + 1) / (count + 1);
+                
+                impl::parallel(count, [&](unsigned i) {
+                    std::vector<IntType> values(width);
+                    std::size_t localExhausted{ 0 };
+                    std::size_t localSteps{ 0 };
+                    matched[i] = impl::candidate<IntType>(p, domain, probes[i], std::span{ values }, predicate,
+                                                          options.fuel, localExhausted, localSteps);
+                    exhausted += localExhausted;
+                    steps += localSteps;
+                });
+                
+                evaluated += count;
+                
+                for (unsigned i{ count }; i-- > 0;)
+                {
+                    if (matched[i])
+                        high = probes[i];
+                    else
+                        low = std::max(low, probes[i] + 1);
+                }
+            }
+            
+            best = high;
+        }
+        else
+        {
+            std::atomic<std::uint64_t> next{ 0 };
+            
+            impl::parallel(impl::searchThreads(options.threads, size, chunk), [&](unsigned) {
+                std::vector<IntType> values(width);
+                std::size_t localEvaluated{ 0 };
+                std::size_t localExhausted{ 0 };
+                std::size_t localSteps{ 0 };
+                
+                for (std::uint64_t begin; (begin = next.fetch_add(chunk, std::memory_order_relaxed)) < size;)
+                {
+                    //  Later chunks cannot hold the first match
+                    if (begin >= best.load(std::memory_order_relaxed))
+                        break;
+                    
+                    const std::uint64_t end{ std::min<std::uint64_t>(begin + chunk, size) };
+                    
+                    for (std::uint64_t index{ begin }; index < end && index < best.load(std::memory_order_relaxed); ++index)
+                    {
+                        ++localEvaluated;
+                        
+                        if (impl::candidate<IntType>(p, domain, index, std::span{ values }, predicate, options.fuel,
+                                                     localExhausted, localSteps))
+                        {
+                            for (std::uint64_t current{ best }; index < current && !best.compare_exchange_weak(current, index);)
+                            {
+                            }
+                            
+                            break;
+                        }
+                    }
+                }
+                
+                evaluated += localEvaluated;
+                exhausted += localExhausted;
+                steps += localSteps;
+            });
+        }
+        
+        metrics::add(metrics::PROGRAMS_EXECUTED, evaluated);
+        metrics::add(metrics::INSTRUCTIONS_DISPATCHED, steps);
+        metrics::add(metrics::FUEL_EXHAUSTED, exhausted);
+        
+        const std::uint64_t match{ best };
+        return { match < size ? std::optional{ match } : std::nullopt, evaluated, exhausted };
+    }
+    
+    //  Finds every candidate in a domain for which predicate(values) is true
+    //  of the final registers of the image, in order.
+    template<std::unsigned_integral IntType, typename Predicate>
+    [[maybe_unused]] [[nodiscard]]
+    searchResults findAll(const image& p, const searchDomain& domain, const Predicate& predicate,
+                          searchOptions options = {})
+    {
+        p.check();
+        const std::uint64_t size{ domain.size() };
+        const std::size_t width{ impl::searchRegisters(p, domain) };
+        const std::size_t chunk{ std::max<std::size_t>(options.chunk, 1) };
+        const trace::span span{ "search", "search" };
+        
+        std::atomic<std::uint64_t> next{ 0 };
+        std::atomic<std::size_t> exhausted{ 0 };
+        std::atomic<std::size_t> steps{ 0 };
+        std::mutex mutex;
+        searchResults result{ {}, static_cast<std::size_t>(size), 0 };
+        
+        impl::parallel(impl::searchThreads(options.threads, size, chunk), [&](unsigned) {
+            std::vector<IntType> values(width);
+            std::vector<std::uint64_t> matches;
+            std::size_t localExhausted{ 0 };
+            std::size_t localSteps{ 0 };
+            
+            for (std::uint64_t begin; (begin = next.fetch_add(chunk, std::memory_order_relaxed)) < size;)
+                for (std::uint64_t index{ begin }; index < std::min<std::uint64_t>(begin + chunk, size); ++index)
+                    if (impl::candidate<IntType>(p, domain, index, std::span{ values }, predicate, options.fuel,
+                                                 localExhausted, localSteps))
+                        matches.push_back(index);
+            
+            exhausted += localExhausted;
+            steps += localSteps;
+            const std::lock_guard lock{ mutex };
+            result.matches.insert(result.matches.end(), matches.begin(), matches.end());
+        });
+        
+        std::sort(result.matches.begin(), result.matches.end());
+        result.exhausted = exhausted;
+        
+        metrics::add(metrics::PROGRAMS_EXECUTED, result.evaluated);
+        metrics::add(metrics::INSTRUCTIONS_DISPATCHED, steps);
+        metrics::add(metrics::FUEL_EXHAUSTED, result.exhausted);
+        return result;
+    }
+    
+    //  Finds the first candidate for which the image leaves y in R0. With
+    //  options.monotone, R0 must not decrease from one candidate to the next
+    //  (of those which halt), and the domain is bisected.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]] [[nodiscard]]
+    searchStatus preimage(const image& p, const searchDomain& domain, IntType y, searchOptions options = {})
+    {
+        if (!options.monotone)
+            return findFirst<IntType>(p, domain, [y](std::span<const IntType> values) { return values[0] == y; }, options);
+        
+        auto result{ findFirst<IntType>(p, domain, [y](std::span<const IntType> values) { return values[0] >= y; },
+                                        options) };
+        
+        if (result.match)
+        {
+            std::vector<IntType> values(impl::searchRegisters(p, domain));
+            std::size_t exhausted{ 0 };
+            std::size_t steps{ 0 };
+            ++result.evaluated;
+            
+            if (!impl::candidate<IntType>(p, domain, *result.match, std::span{ values },
+                                          [y](std::span<const IntType> v) { return v[0] == y; }, options.fuel, exhausted,
+                                          steps))
+                result.match.reset();
+            
+            result.exhausted += exhausted;
+            metrics::add(metrics::PROGRAMS_EXECUTED);
+            metrics::add(metrics::INSTRUCTIONS_DISPATCHED, steps);
+            metrics::add(metrics::FUEL_EXHAUSTED, exhausted);
+        }
+        
+        return result;
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_SEARCH_HPP
@@ -0,0 +1,218 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_SNAPSHOT_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_SNAPSHOT_HPP
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "runtime.hpp"
+
+//  Incremental re-execution for sweeps which vary registers that a program
+//  reads late in its execution.
+//
+//  A register is read when it is decremented: until then, its value can
+//  only have been incremented, so it has no effect on the other registers or
+//  the lines executed. The state of an execution just before the first read
+//  of a register is therefore the same for every input which differs from
+//  the recorded one only in registers that are read no earlier, apart from
+//  those registers themselves, which differ by the same amounts as the
+//  inputs.
+namespace ctrm
+{
+    //  Executes an image once on a base input, recording the step at which
+    //  each register is first read and the registers just before it, so that
+    //  later inputs resume from the latest snapshot taken before any of the
+    //  registers they change are read.
+    template<std::unsigned_integral IntType>
+    class snapshots
+    {
+    public:
+        //  Step returned by firstRead() for registers which are never read.
+        static constexpr std::size_t never{ std::numeric_limits<std::size_t>::max() };
+        
+        //  Executes p on the registers in base, one instruction at a time
+        //  until every register has been read, and then as run() does.
+        //  Throws std::length_error if there are fewer values than registers,
+        //  and std::invalid_argument if the image has not been analysed.
+        snapshots(image p, std::span<const IntType> base, std::size_t fuel = std::numeric_limits<std::size_t>::max()) :
+                program{ std::move(p) },
+                base(base.begin(), base.end()),
+                reads(this->base.size(), never)
+        {
+            if (this->base.size() < program.registerCount)
+                throw std::length_error("not enough registers for program");
+            
+            program.check();
+            
+            const metrics::timer timer{ metrics::RUN_DURATION };
+            const trace::span span{ "snapshot", "exec" };
+            std::vector<IntType> values{ this->base };
+            std::size_t loc{ 0 };
+            std::size_t steps{ 0 };
+            std::size_t unread{ program.registerCount };
+            bool halted{ false };
+            
+            save(0, 0, values);
+            
+            while (unread != 0)
+            {
+                if (loc >= program.instructions.size() || program.instructions[loc].type == impl::HALT)
+                {
+                    halted = true;
+                    break;
+                }
+                
+                if (steps == fuel)
+                    break;
+                
+                const auto& ins{ program.instructions[loc] };
+                auto& value{ values[ins.currentRegister] };
+                
+                if (ins.type == impl::DECR && reads[ins.currentRegister] == never)
+                {
+                    reads[ins.currentRegister] = steps;
+                    --unread;
+                    
+                    if (steps != 0)
+                        save(steps, loc, values);
+                }
+                
+                ++steps;
+                
+                if (ins.type == impl::INCR)
+                {
+                    ++value;
+                    loc = ins.location1;
+                }
+                else if (value > 0)
+                {
+                    --value;
+                    loc = ins.location1;
+                }
+                else
+                {
+                    loc = ins.location2;
+                }
+            }
+            
+            if (!halted)
+            {
+                const status rest{ impl::execute<IntType>(program.instructions, program.annotations, values, loc,
+                                                          fuel - steps) };
+                loc = rest.location;
+                steps += rest.steps;
+                halted = rest.halted;
+            }
+            
+            result = { loc, steps, halted };
+            save(steps, loc, values);
+            
+            metrics::add(metrics::PROGRAMS_EXECUTED);
+            metrics::add(metrics::INSTRUCTIONS_DISPATCHED, steps);
+            
+            if (!halted)
+                metrics::add(metrics::FUEL_EXHAUSTED);
+        }
+        
+        //  Executes the image on the registers in values as run() does,
+        //  starting from the latest snapshot at which every register whose
+        //  value differs from the base input is still unread. The status
+        //  counts the steps of the whole execution, including those skipped.
+        status run(std::span<IntType> values, std::size_t fuel = std::numeric_limits<std::size_t>::max()) const
+        {
+            if (values.size() < program.registerCount)
+                throw std::length_error("not enough registers for program");
+            
+            const metrics::timer timer{ metrics::RUN_DURATION };
+            const trace::span span{ "resume", "exec" };
+            
+            const std::size_t stride{ program.registerCount };
+            std::size_t limit{ never };
+            
+            for (std::size_t i{ 0 }; i < stride; ++i)
+                if (values[i] != base[i])
+                    limit = std::min(limit, reads[i]);
+            
+            //  A snapshot at the step of the first read can be used, as it is
+            //  taken before the read
+            const std::size_t stop{ std::min(limit, fuel) };
+            const snapshot* from{ &taken.front() };
+            
+            for (const auto& s : taken)
+                if (s.step <= stop)
+                    from = &s;
+            
+            const auto state{ std::span{ states }.subspan(static_cast<std::size_t>(from - taken.data()) * stride, stride) };
+            
+            for (std::size_t i{ 0 }; i < stride; ++i)
+                values[i] = static_cast<IntType>(state[i] + (values[i] - base[i]));
+            
+            status s{ impl::execute<IntType>(program.instructions, program.annotations, values, from->location,
+                                             fuel - from->step) };
+            
+            metrics::add(metrics::PROGRAMS_EXECUTED);
+            metrics::add(metrics::INSTRUCTIONS_DISPATCHED, s.steps);
+            
+            if (!s.halted)
+                metrics::add(metrics::FUEL_EXHAUSTED);
+            
+            s.steps += from->step;
+            return s;
+        }
+        
+        //  The step at which a register is first read by the base input, or
+        //  never if it is not read before the program stops.
+        [[nodiscard]]
+        std::size_t firstRead(std::size_t reg) const
+        {
+            return reg < reads.size() ? reads[reg] : never;
+        }
+        
+        //  The status of the execution on the base input.
+        [[nodiscard]]
+        status baseStatus() const
+        {
+            return result;
+        }
+    
+    private:
+        struct snapshot
+        {
+            std::size_t step;
+            std::size_t location;
+        };
+        
+        image program;
+        std::vector<IntType> base;
+        std::vector<std::size_t> reads;
+        std::vector<snapshot> taken;
+        std::vector<IntType> states;
+        status result{};
+        
+        void save(std::size_t step, std::size_t location, std::span<const IntType> values)
+        {
+            taken.push_back({ step, location });
+            states.insert(states.end(), values.begin(), values.begin() + static_cast<std::ptrdiff_t>(program.registerCount));
+        }
+    };
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_SNAPSHOT_HPP
@@ -0,0 +1,586 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_STREAM_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_STREAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>) && __has_include(<sys/mman.h>) && __has_include(<sys/syscall.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define CTRM_STREAM_HAS_IO_URING 1
+#endif
+
+#include "runtime.hpp"
+
+//  Executes batches which are too large to fit in memory, reading the rows
+//  of registers from a file and writing the results to another as the rows
+//  are executed. Files are read and written in large chunks through
+//  io_uring where the kernel allows it, and otherwise with pread() and
+//  pwrite() on a separate thread, so that I/O overlaps with execution either
+//  way. Requires a POSIX system.
+namespace ctrm
+{
+    namespace impl
+    {
+        //  Memory for one chunk, aligned to a page so that it can also be
+        //  used with files opened with O_DIRECT.
+        class alignedBuffer
+        {
+        private:
+            static constexpr std::align_val_t alignment{ 4096 };
+            std::uint64_t* data{ nullptr };
+        
+        public:
+            explicit alignedBuffer(std::size_t count) :
+                    data{ static_cast<std::uint64_t*>(::operator new(std::max<std::size_t>(count, 1) * sizeof(std::uint64_t),
+                                                                      alignment)) }
+            {
+            }
+            
+            alignedBuffer(const alignedBuffer&) = delete;
+            alignedBuffer& operator=(const alignedBuffer&) = delete;
+            
+            ~alignedBuffer()
+            {
+                ::operator delete(data, alignment);
+            }
+            
+            [[nodiscard]]
+            std::uint64_t* get() const
+            {
+                return data;
+            }
+        };
+        
+        //  Reads or writes the whole of a request with blocking calls,
+        //  stopping early only at the end of the file. Returns the number of
+        //  bytes transferred, or a negated error number.
+        inline std::int64_t transferAll(bool write, int fd, std::byte* data, std::size_t size, std::uint64_t offset)
+        {
+            std::size_t done{ 0 };
+            
+            while (done < size)
+            {
+                const auto n{ write ? ::pwrite(fd, data + done, size - done, static_cast<off_t>(offset + done))
+                                    : ::pread(fd, data + done, size - done, static_cast<off_t>(offset + done)) };
+                
+                if (n < 0 && errno == EINTR)
+                    continue;
+                
+                if (n < 0)
+                    return -errno;
+                
+                if (n == 0)
+                    break;
+                
+                done += static_cast<std::size_t>(n);
+            }
+            
+            return static_cast<std::int64_t>(done);
+        }
+        
+#ifdef CTRM_STREAM_HAS_IO_URING
+        //  The submission and completion queues of an io_uring instance,
+        //  driven with system calls directly so that liburing is not needed.
+        class ring
+        {
+        private:
+            int fd{ -1 };
+            void* queues{ MAP_FAILED };
+            std::size_t queuesSize{ 0 };
+            void* completions{ MAP_FAILED };
+            std::size_t completionsSize{ 0 };
+            io_uring_sqe* entries{ static_cast<io_uring_sqe*>(MAP_FAILED) };
+            std::size_t entriesSize{ 0 };
+            
+            unsigned* sqHead{ nullptr };
+            unsigned* sqTail{ nullptr };
+            unsigned* sqArray{ nullptr };
+            unsigned sqMask{ 0 };
+            unsigned* cqHead{ nullptr };
+            unsigned* cqTail{ nullptr };
+            io_uring_cqe* cqes{ nullptr };
+            unsigned cqMask{ 0 };
+            
+            template<typename T>
+            static T* at(void* base, std::uint32_t offset)
+            {
+                return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+            }
+            
+            int enter(unsigned submit, unsigned wait) const
+            {
+                const unsigned flags{ wait == 0 ? 0u : static_cast<unsigned>(IORING_ENTER_GETEVENTS) };
+                return static_cast<int>(::syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0));
+            }
+            
+            //  Whether the kernel supports reads and writes, which were added
+            //  in Linux 5.6 along with probing. Earlier kernels can set up a
+            //  ring, but fail both the probe and every request.
+            bool supportsReadWrite() const
+            {
+                constexpr unsigned opCount{ 256 };
+                constexpr std::size_t probeSize{ sizeof(io_uring_probe) + opCount * sizeof(io_uring_probe_op) };
+                alignas(io_uring_probe) std::array<std::byte, probeSize> buffer{};
+                auto* probe{ reinterpret_cast<io_uring_probe*>(buffer.data()) };
+                
+                if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, opCount) < 0)
+                    return false;
+                
+                for (const unsigned op : { IORING_OP_READ, IORING_OP_WRITE })
+                    if (op > probe->last_op || (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0)
+                        return false;
+                
+                return true;
+            }
+        
+        public:
+            //  Sets up a ring with room for the given number of requests.
+            //  Leaves the ring closed if io_uring is not available, e.g. in a
+            //  container which does not allow it, or cannot read and write.
+            explicit ring(unsigned size)
+            {
+                io_uring_params params{};
+                fd = static_cast<int>(::syscall(__NR_io_uring_setup, size, &params));
+                
+                if (fd < 0)
+                    return;
+                
+                if (!supportsReadWrite())
+                {
+                    close();
+                    return;
+                }
+                
+                queuesSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                completionsSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                entriesSize = params.sq_entries * sizeof(io_uring_sqe);
+                
+                if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+                    queuesSize = completionsSize = std::max(queuesSize, completionsSize);
+                
+                queues = ::mmap(nullptr, queuesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_SQ_RING);
+                
+                if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+                    completions = queues;
+                else if (queues != MAP_FAILED)
+                    completions = ::mmap(nullptr, completionsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                         fd, IORING_OFF_CQ_RING);
+                
+                if (completions != MAP_FAILED)
+                    entries = static_cast<io_uring_sqe*>(::mmap(nullptr, entriesSize, PROT_READ | PROT_WRITE,
+                                                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+                
+                if (entries == MAP_FAILED)
+                {
+                    close();
+                    return;
+                }
+                
+                sqHead = at<unsigned>(queues, params.sq_off.head);
+                sqTail = at<unsigned>(queues, params.sq_off.tail);
+                sqArray = at<unsigned>(queues, params.sq_off.array);
+                sqMask = *at<unsigned>(queues, params.sq_off.ring_mask);
+                cqHead = at<unsigned>(completions, params.cq_off.head);
+                cqTail = at<unsigned>(completions, params.cq_off.tail);
+                cqes = at<io_uring_cqe>(completions, params.cq_off.cqes);
+                cqMask = *at<unsigned>(completions, params.cq_off.ring_mask);
+            }
+            
+            ring(const ring&) = delete;
+            ring& operator=(const ring&) = delete;
+            
+            ~ring()
+            {
+                close();
+            }
+            
+            void close()
+            {
+                if (entries != MAP_FAILED)
+                    ::munmap(entries, entriesSize);
+                
+                if (completions != MAP_FAILED && completions != queues)
+                    ::munmap(completions, completionsSize);
+                
+                if (queues != MAP_FAILED)
+                    ::munmap(queues, queuesSize);
+                
+                if (fd >= 0)
+                    ::close(fd);
+                
+                entries = static_cast<io_uring_sqe*>(MAP_FAILED);
+                completions = queues = MAP_FAILED;
+                fd = -1;
+            }
+            
+            [[nodiscard]]
+            bool open() const
+            {
+                return fd >= 0;
+            }
+            
+            //  Queues a read or write of at most 1 GiB and submits it. The
+            //  caller must not have more requests in flight than the ring
+            //  has room for.
+            bool submit(std::uint64_t ticket, bool write, int file, std::byte* data, std::size_t size,
+                        std::uint64_t offset)
+            {
+                const unsigned tail{ *sqTail };
+                io_uring_sqe& sqe{ entries[tail & sqMask] };
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+                sqe.fd = file;
+                sqe.addr = reinterpret_cast<std::uint64_t>(data);
+                sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(size, std::size_t{ 1 } << 30));
+                sqe.off = offset;
+                sqe.user_data = ticket;
+                sqArray[tail & sqMask] = tail & sqMask;
+                std::atomic_ref{ *sqTail }.store(tail + 1, std::memory_order_release);
+                
+                int result;
+                while ((result = enter(1, 0)) < 0 && errno == EINTR);
+                return result == 1;
+            }
+            
+            //  Waits for at least one request to complete, and passes the
+            //  ticket and result of every completed request to done.
+            template<typename Done>
+            void complete(Done&& done)
+            {
+                unsigned head{ *cqHead };
+                
+                while (head == std::atomic_ref{ *cqTail }.load(std::memory_order_acquire))
+                    if (enter(0, 1) < 0 && errno != EINTR)
+                        throw std::system_error{ errno, std::system_category(), "io_uring_enter" };
+                
+                for (; head != std::atomic_ref{ *cqTail }.load(std::memory_order_acquire); ++head)
+                {
+                    const io_uring_cqe& cqe{ cqes[head & cqMask] };
+                    done(cqe.user_data, static_cast<std::int64_t>(cqe.res));
+                    std::atomic_ref{ *cqHead }.store(head + 1, std::memory_order_release);
+                }
+            }
+        };
+#endif
+        
+        //  Reads and writes files at given offsets in the background. Each
+        //  request is identified by a ticket, and is only complete once it
+        //  has been waited for. Every request still in flight is waited for
+        //  on destruction, so buffers must outlive the queue.
+        class ioQueue
+        {
+        private:
+            struct request
+            {
+                bool write;
+                int fd;
+                std::byte* data;
+                std::size_t size;
+                std::uint64_t offset;
+                bool done{ false };
+                std::int64_t result{ 0 };
+            };
+            
+            std::map<std::uint64_t, request> requests;
+            std::uint64_t nextTicket{ 0 };
+            
+#ifdef CTRM_STREAM_HAS_IO_URING
+            ring uring;
+#endif
+            
+            //  Without io_uring, requests are carried out in order by a
+            //  single thread.
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::deque<std::uint64_t> queued;
+            bool stopping{ false };
+            std::jthread worker;
+            
+            void work()
+            {
+                std::unique_lock lock{ mutex };
+                
+                while (true)
+                {
+                    changed.wait(lock, [&] { return stopping || !queued.empty(); });
+                    
+                    if (queued.empty())
+                        return;
+                    
+                    request& r{ requests.at(queued.front()) };
+                    queued.pop_front();
+                    lock.unlock();
+                    const auto result{ transferAll(r.write, r.fd, r.data, r.size, r.offset) };
+                    lock.lock();
+                    r.result = result;
+                    r.done = true;
+                    changed.notify_all();
+                }
+            }
+        
+        public:
+            //  Uses io_uring if asked to and the kernel allows it, with room
+            //  for the given number of requests in flight.
+            ioQueue([[maybe_unused]] bool ioUring, [[maybe_unused]] unsigned depth)
+#ifdef CTRM_STREAM_HAS_IO_URING
+                    : uring{ ioUring ? std::bit_ceil(std::max(depth, 1u)) : 0u }
+#endif
+            {
+                if (!usingIoUring())
+                    worker = std::jthread{ [this] { work(); } };
+            }
+            
+            ioQueue(const ioQueue&) = delete;
+            ioQueue& operator=(const ioQueue&) = delete;
+            
+            ~ioQueue()
+            {
+                while (!requests.empty())
+                {
+                    try
+                    {
+                        wait(requests.begin()->first);
+                    }
+                    catch (const std::system_error&)
+                    {
+                    }
+                }
+                
+                {
+                    const std::lock_guard lock{ mutex };
+                    stopping = true;
+                }
+                
+                changed.notify_all();
+            }
+            
+            [[nodiscard]]
+            bool usingIoUring() const
+            {
+#ifdef CTRM_STREAM_HAS_IO_URING
+                return uring.open();
+#else
+                return false;
+#endif
+            }
+            
+            std::uint64_t submit(bool write, int fd, std::span<std::byte> data, std::uint64_t offset)
+            {
+                const std::uint64_t ticket{ nextTicket++ };
+                
+                {
+                    const std::lock_guard lock{ mutex };
+                    requests.emplace(ticket, request{ write, fd, data.data(), data.size(), offset });
+                }
+                
+#ifdef CTRM_STREAM_HAS_IO_URING
+                if (usingIoUring())
+                {
+                    if (!uring.submit(ticket, write, fd, data.data(), data.size(), offset))
+                    {
+                        //  Fall back to a blocking call if it cannot be queued
+                        request& r{ requests.at(ticket) };
+                        r.result = transferAll(write, fd, r.data, r.size, offset);
+                        r.done = true;
+                    }
+                    
+                    return ticket;
+                }
+#endif
+                
+                {
+                    const std::lock_guard lock{ mutex };
+                    queued.push_back(ticket);
+                }
+                
+                changed.notify_all();
+                return ticket;
+            }
+            
+            //  Waits for a request to complete and returns the number of
+            //  bytes transferred, which is less than requested only at the
+            //  end of a file. Throws std::system_error if the request failed.
+            std::size_t wait(std::uint64_t ticket)
+            {
+#ifdef CTRM_STREAM_HAS_IO_URING
+                while (usingIoUring() && !requests.at(ticket).done)
+                {
+                    uring.complete([&](std::uint64_t t, std::int64_t result) {
+                        request& r{ requests.at(t) };
+                        r.done = true;
+                        r.result = result;
+                        
+                        //  Finish short transfers, which io_uring may return
+                        //  before the end of a file
+                        if (result > 0 && static_cast<std::size_t>(result) < r.size)
+                        {
+                            const auto done{ static_cast<std::size_t>(result) };
+                            const auto rest{ transferAll(r.write, r.fd, r.data + done, r.size - done, r.offset + done) };
+                            r.result = rest < 0 ? rest : result + rest;
+                        }
+                    });
+                }
+#endif
+                
+                std::unique_lock lock{ mutex };
+                changed.wait(lock, [&] { return requests.at(ticket).done; });
+                const std::int64_t result{ requests.at(ticket).result };
+                requests.erase(ticket);
+                
+                if (result < 0)
+                    throw std::system_error{ static_cast<int>(-result), std::system_category(), "stream I/O" };
+                
+                return static_cast<std::size_t>(result);
+            }
+        };
+    }
+    
+    struct streamOptions
+    {
+        //  Number of rows read, executed and written at a time.
+        std::size_t chunkRows{ 65536 };
+        
+        //  Number of chunks held in memory at once: with three, one chunk is
+        //  executed while the next is read and the last is written.
+        std::size_t buffers{ 3 };
+        
+        std::size_t fuel{ std::numeric_limits<std::size_t>::max() };
+        unsigned threads{ 0 };
+        
+        //  Uses io_uring where available. Otherwise, or when the kernel does
+        //  not allow it, files are read and written on a separate thread.
+        bool ioUring{ true };
+    };
+    
+    //  Executes an image once for each row of stride 64-bit registers in the
+    //  input file, and writes the final value of the first register of each
+    //  row to the output file, both in native byte order. The rows of each
+    //  chunk are executed in parallel as with runBatch(). Memory use depends
+    //  only on the options, not on the size of the input. Throws
+    //  std::invalid_argument if the input ends part way through a row, and
+    //  std::system_error if a file cannot be read or written.
+    [[maybe_unused]]
+    inline batchStatus runStream(const image& p, int input, int output, std::size_t stride,
+                                 const streamOptions& options = {})
+    {
+        if (stride < p.registerCount)
+            throw std::length_error("not enough registers for program");
+        
+        if (options.chunkRows == 0 || options.buffers == 0)
+            throw std::invalid_argument("stream options must allow at least one row in memory");
+        
+        p.check();
+        const trace::span span{ "stream", "batch" };
+        
+        constexpr std::uint64_t none{ std::numeric_limits<std::uint64_t>::max() };
+        const std::size_t rowBytes{ stride * sizeof(std::uint64_t) };
+        const std::size_t chunkBytes{ options.chunkRows * rowBytes };
+        
+        struct slot
+        {
+            impl::alignedBuffer rows;
+            impl::alignedBuffer results;
+            std::uint64_t read{ none };
+            std::uint64_t write{ none };
+            std::uint64_t firstRow{ 0 };
+            
+            slot(std::size_t rowCount, std::size_t stride) :
+                    rows{ rowCount * stride },
+                    results{ rowCount }
+            {
+            }
+        };
+        
+        //  The queue is destroyed first, so no request outlives its buffer
+        std::deque<slot> slots;
+        impl::ioQueue io{ options.ioUring, static_cast<unsigned>(2 * options.buffers) };
+        std::uint64_t nextRow{ 0 };
+        batchStatus total{ 0, 0, 0 };
+        
+        const auto read{ [&](slot& s) {
+            s.firstRow = nextRow;
+            const std::span<std::byte> data{ reinterpret_cast<std::byte*>(s.rows.get()), chunkBytes };
+            s.read = io.submit(false, input, data, nextRow * rowBytes);
+            nextRow += options.chunkRows;
+        } };
+        
+        for (std::size_t i{ 0 }; i < options.buffers; ++i)
+            read(slots.emplace_back(options.chunkRows, stride));
+        
+        for (std::size_t i{ 0 }; slots[i].read != none; i = (i + 1) % slots.size())
+        {
+            slot& s{ slots[i] };
+            const std::size_t bytes{ io.wait(std::exchange(s.read, none)) };
+            const std::size_t rows{ bytes / rowBytes };
+            
+            if (bytes % rowBytes != 0)
+                throw std::invalid_argument("input ends part way through a row");
+            
+            //  The results of the chunk before must be written first
+            if (s.write != none)
+                io.wait(std::exchange(s.write, none));
+            
+            if (rows != 0)
+            {
+                const auto batch{ runBatch<std::uint64_t>(p, { s.rows.get(), rows * stride }, stride, options.fuel,
+                                                          options.threads) };
+                total.runs += batch.runs;
+                total.steps += batch.steps;
+                total.exhausted += batch.exhausted;
+                
+                for (std::size_t row{ 0 }; row < rows; ++row)
+                    s.results.get()[row] = s.rows.get()[row * stride];
+                
+                const std::span<std::byte> data{ reinterpret_cast<std::byte*>(s.results.get()), rows * sizeof(std::uint64_t) };
+                s.write = io.submit(true, output, data, s.firstRow * sizeof(std::uint64_t));
+            }
+            
+            //  Keep reading until the end of the input is found
+            if (bytes == chunkBytes)
+                read(s);
+        }
+        
+        for (slot& s : slots)
+            if (s.write != none)
+                io.wait(std::exchange(s.write, none));
+        
+        return total;
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_STREAM_HPP
@@ -0,0 +1,354 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_SUPERINSTRUCTIONS_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_SUPERINSTRUCTIONS_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "runtime.hpp"
+
+//  Superinstructions execute a sequence of instructions, each following the
+//  first jump of the one before, in a single dispatch. This benefits programs
+//  made of long runs of straight-line code, such as generated programs, where
+//  there are few loops for run() to execute in constant time.
+namespace ctrm
+{
+    namespace impl
+    {
+        //  Longest sequence of instructions executed by a superinstruction.
+        inline constexpr std::size_t maxSequence{ 3 };
+        
+        //  Every sequence of up to maxSequence increments and decrements has
+        //  its own opcode, numbered by length and then by the positions of
+        //  its decrements. Opcode 0 is HALT.
+        inline constexpr std::size_t opcodeCount{ (std::size_t{ 1 } << (maxSequence + 1)) - 1 };
+        
+        constexpr std::size_t opcode(std::size_t length, std::size_t decrements)
+        {
+            return (std::size_t{ 1 } << length) - 1 + decrements;
+        }
+        
+        constexpr std::size_t sequenceLength(std::size_t op)
+        {
+            return static_cast<std::size_t>(std::bit_width(op + 1)) - 1;
+        }
+        
+        //  Bit i is set if the instruction at position i is a decrement.
+        constexpr std::size_t sequenceDecrements(std::size_t op)
+        {
+            return op + 1 - (std::size_t{ 1 } << sequenceLength(op));
+        }
+        
+        //  A decrement which finds its register holding zero leaves the
+        //  sequence, jumping to its exit.
+        struct superinstruction
+        {
+            std::size_t opcode;
+            std::size_t length;
+            std::array<std::size_t, maxSequence> registers;
+            std::array<std::size_t, maxSequence> lines;
+            std::array<std::size_t, maxSequence> exits;
+            std::size_t next;
+        };
+        
+        //  Executes the first count instructions of a superinstruction.
+        template<std::unsigned_integral IntType>
+        void dispatch(const superinstruction& s, IntType* values, std::size_t& loc, std::size_t& steps,
+                      std::size_t decrements, std::size_t count)
+        {
+            for (std::size_t i{ 0 }; i < count; ++i)
+            {
+                IntType& value{ values[s.registers[i]] };
+                
+                if ((decrements >> i & 1) == 0)
+                {
+                    ++value;
+                }
+                else if (value > 0)
+                {
+                    --value;
+                }
+                else
+                {
+                    steps += i + 1;
+                    loc = s.exits[i];
+                    return;
+                }
+            }
+            
+            steps += count;
+            loc = count < s.length ? s.lines[count] : s.next;
+        }
+        
+        //  Handler for a single opcode, which the compiler unrolls.
+        template<std::unsigned_integral IntType, std::size_t op>
+        void dispatch(const superinstruction& s, IntType* values, std::size_t& loc, std::size_t& steps)
+        {
+            dispatch(s, values, loc, steps, sequenceDecrements(op), sequenceLength(op));
+        }
+        
+        template<std::unsigned_integral IntType>
+        using handler = void (*)(const superinstruction&, IntType*, std::size_t&, std::size_t&);
+        
+        template<std::unsigned_integral IntType, std::size_t... ops>
+        constexpr std::array<handler<IntType>, opcodeCount> makeHandlers(std::index_sequence<ops...>)
+        {
+            return { &dispatch<IntType, ops>... };
+        }
+        
+        template<std::unsigned_integral IntType>
+        inline constexpr auto handlers{ makeHandlers<IntType>(std::make_index_sequence<opcodeCount>{}) };
+        
+        //  Follows the first jumps from a line for up to maxSequence
+        //  instructions, stopping at a line which does not exist or halts.
+        inline superinstruction sequence(const image& p, std::size_t line, std::size_t& decrements)
+        {
+            superinstruction s{};
+            decrements = 0;
+            
+            for (std::size_t loc{ line }; s.length < maxSequence; loc = p.instructions[loc].location1)
+            {
+                if (loc >= p.instructions.size() || p.instructions[loc].type == HALT)
+                    break;
+                
+                const auto& ins{ p.instructions[loc] };
+                
+                if (ins.type == DECR)
+                    decrements |= std::size_t{ 1 } << s.length;
+                
+                s.registers[s.length] = ins.currentRegister;
+                s.lines[s.length] = loc;
+                s.exits[s.length] = ins.location2;
+                s.next = ins.location1;
+                ++s.length;
+            }
+            
+            return s;
+        }
+    }
+    
+    //  Describes where a fused image stopped, along with the number of
+    //  superinstructions dispatched to get there.
+    struct fusedStatus : status
+    {
+        std::size_t dispatches;
+    };
+    
+    //  An image in which every line starts a superinstruction. Only the
+    //  patterns chosen when fusing the image are used, and lines at which
+    //  no chosen pattern starts execute a single instruction.
+    struct fusedImage
+    {
+        std::size_t registerCount{ 1 };
+        std::vector<impl::superinstruction> code;
+        std::vector<std::size_t> patterns;
+    };
+    
+    //  Executes an image one instruction at a time, and returns the number
+    //  of times each line was executed. If zeros is given, it must have one
+    //  count for each line, and the number of times each decrement found its
+    //  register at zero is added to it. Where the execution stopped is
+    //  stored in outcome.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]] [[nodiscard]]
+    std::vector<std::size_t> profile(const image& p, std::span<IntType> values, std::size_t fuel,
+                                     std::span<std::size_t> zeros, status& outcome)
+    {
+        if (values.size() < p.registerCount)
+            throw std::length_error("not enough registers for program");
+        
+        if (!zeros.empty() && zeros.size() != p.instructions.size())
+            throw std::invalid_argument("profile does not match the image");
+        
+        std::vector<std::size_t> counts(p.instructions.size());
+        std::size_t loc{ 0 };
+        std::size_t steps{ 0 };
+        
+        for (; steps < fuel && loc < p.instructions.size(); ++steps)
+        {
+            const auto& ins{ p.instructions[loc] };
+            
+            if (ins.type == impl::HALT)
+                break;
+            
+            auto& value{ values[ins.currentRegister] };
+            ++counts[loc];
+            
+            if (ins.type == impl::INCR)
+            {
+                ++value;
+                loc = ins.location1;
+            }
+            else if (value > 0)
+            {
+                --value;
+                loc = ins.location1;
+            }
+            else
+            {
+                if (!zeros.empty())
+                    ++zeros[loc];
+                
+                loc = ins.location2;
+            }
+        }
+        
+        outcome = { loc, steps, loc >= p.instructions.size() || p.instructions[loc].type == impl::HALT };
+        return counts;
+    }
+    
+    //  Profiles an image as above, discarding where the execution stopped.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]] [[nodiscard]]
+    std::vector<std::size_t> profile(const image& p, std::span<IntType> values,
+                                     std::size_t fuel = std::numeric_limits<std::size_t>::max(),
+                                     std::span<std::size_t> zeros = {})
+    {
+        status outcome;
+        return profile(p, values, fuel, zeros, outcome);
+    }
+    
+    //  Counts the patterns of two or more instructions starting at every
+    //  line, indexed by opcode. Each is weighted by the number of dispatches
+    //  it would save: once per execution of the line according to a profile,
+    //  or once per line without one.
+    [[maybe_unused]] [[nodiscard]]
+    inline std::array<std::size_t, impl::opcodeCount> countPatterns(const image& p,
+                                                                   std::span<const std::size_t> counts = {})
+    {
+        std::array<std::size_t, impl::opcodeCount> result{};
+        
+        for (std::size_t line{ 0 }; line < p.instructions.size(); ++line)
+        {
+            std::size_t decrements;
+            const auto s{ impl::sequence(p, line, decrements) };
+            const std::size_t weight{ counts.empty() ? 1 : counts[line] };
+            
+            for (std::size_t length{ 2 }; length <= s.length; ++length)
+            {
+                const std::size_t mask{ (std::size_t{ 1 } << length) - 1 };
+                result[impl::opcode(length, decrements & mask)] += weight * (length - 1);
+            }
+        }
+        
+        return result;
+    }
+    
+    //  Builds superinstructions for an image from the given number of most
+    //  frequent patterns (see countPatterns()). A profile of the image, if
+    //  given, has one count for each line.
+    [[maybe_unused]] [[nodiscard]]
+    inline fusedImage fuse(const image& p, std::span<const std::size_t> counts = {}, std::size_t budget = 8)
+    {
+        if (!counts.empty() && counts.size() != p.instructions.size())
+            throw std::invalid_argument("profile does not match the image");
+        
+        fusedImage result;
+        result.registerCount = p.registerCount;
+        
+        const auto frequencies{ countPatterns(p, counts) };
+        std::array<bool, impl::opcodeCount> enabled{};
+        
+        for (std::size_t op{ 0 }; op < impl::opcodeCount; ++op)
+            if (frequencies[op] != 0)
+                result.patterns.push_back(op);
+        
+        std::stable_sort(result.patterns.begin(), result.patterns.end(),
+                         [&](std::size_t a, std::size_t b) { return frequencies[a] > frequencies[b]; });
+        result.patterns.resize(std::min(result.patterns.size(), budget));
+        
+        for (const std::size_t op : result.patterns)
+            enabled[op] = true;
+        
+        result.code.reserve(p.instructions.size());
+        
+        for (std::size_t line{ 0 }; line < p.instructions.size(); ++line)
+        {
+            std::size_t decrements;
+            auto s{ impl::sequence(p, line, decrements) };
+            const auto op{ [&] { return impl::opcode(s.length, decrements & ((std::size_t{ 1 } << s.length) - 1)); } };
+            
+            //  Use the longest chosen pattern, or a single instruction
+            while (s.length > 1 && !enabled[op()])
+            {
+                --s.length;
+                s.next = s.lines[s.length];
+            }
+            
+            s.opcode = s.length == 0 ? 0 : op();
+            result.code.push_back(s);
+        }
+        
+        return result;
+    }
+    
+    //  Executes a fused image on the registers in values, stopping once the
+    //  program halts or after fuel instructions have been executed. The
+    //  registers and steps are the same as for run(), but loops are not
+    //  executed in constant time.
+    template<std::unsigned_integral IntType>
+    [[maybe_unused]]
+    fusedStatus run(const fusedImage& p, std::span<IntType> values,
+                    std::size_t fuel = std::numeric_limits<std::size_t>::max())
+    {
+        if (values.size() < p.registerCount)
+            throw std::length_error("not enough registers for program");
+        
+        const metrics::timer timer{ metrics::RUN_DURATION };
+        const trace::span span{ "run", "exec" };
+        
+        constexpr auto& handlers{ impl::handlers<IntType> };
+        std::size_t loc{ 0 };
+        std::size_t steps{ 0 };
+        std::size_t dispatches{ 0 };
+        bool halted{ true };
+        
+        while (loc < p.code.size() && p.code[loc].opcode != 0)
+        {
+            if (steps == fuel)
+            {
+                halted = false;
+                break;
+            }
+            
+            const auto& s{ p.code[loc] };
+            ++dispatches;
+            
+            //  Execute only part of the sequence if there is not enough fuel
+            if (fuel - steps >= s.length)
+                handlers[s.opcode](s, values.data(), loc, steps);
+            else
+                impl::dispatch(s, values.data(), loc, steps, impl::sequenceDecrements(s.opcode), fuel - steps);
+        }
+        
+        metrics::add(metrics::PROGRAMS_EXECUTED);
+        metrics::add(metrics::INSTRUCTIONS_DISPATCHED, steps);
+        metrics::add(metrics::SUPERINSTRUCTIONS_DISPATCHED, dispatches);
+        
+        if (!halted)
+            metrics::add(metrics::FUEL_EXHAUSTED);
+        
+        return { { loc, steps, halted }, dispatches };
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_SUPERINSTRUCTIONS_HPP
@@ -0,0 +1,179 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_TABULATE_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_TABULATE_HPP
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "../ctrm.hpp"
+
+//  Tables of the results of a program, evaluated at compile time in shards
+//  which can be compiled in parallel.
+//
+//  Each shard is a translation unit defining one segment of the table with
+//  CTRM_TABLE_SEGMENT(), which is placed in a linker section named after
+//  the table. The linker concatenates the segments in the order their
+//  translation units are linked, and CTRM_TABLE() declares a function
+//  returning the whole table, using the symbols which ELF linkers define at
+//  the start and end of the section. Each shard also records the index and
+//  address of its segment in a second section. If the segments were linked
+//  out of order, name() copies them into place once, on its first call;
+//  otherwise the table is returned where it was linked.
+//  The shards must be linked directly into an executable or shared library,
+//  as unreferenced objects are not taken from static libraries.
+//  ctrm_add_table() in CMake generates the shards and the header declaring
+//  the table.
+namespace ctrm
+{
+    namespace impl
+    {
+        //  Inputs of a table in which the entry at index i is the result of
+        //  executing the program with i in R1.
+        struct indexInput
+        {
+            template<std::unsigned_integral IntType>
+            constexpr void operator()(std::size_t index, std::span<IntType> registers) const
+            {
+                registers[1] = static_cast<IntType>(index);
+            }
+        };
+        
+        template<std::unsigned_integral IntType, std::size_t maxRegisters, std::size_t instrCount, typename Inputs>
+        constexpr IntType tabulate(const program<maxRegisters, instrCount>& p, std::size_t index, const Inputs& inputs)
+        {
+            std::array<IntType, maxRegisters> values{};
+            inputs(index, std::span<IntType>{ values });
+            execute<IntType>(p.instructions, p.annotations, values, 0, std::numeric_limits<std::size_t>::max());
+            return values[0];
+        }
+        
+        //  Each entry is a separate constant evaluation, so that the limits
+        //  on the operations of an evaluation apply to each entry rather
+        //  than to a whole segment.
+        template<auto p, std::unsigned_integral IntType, std::size_t index, auto inputs>
+        inline constexpr IntType entry{ tabulate<IntType>(p, index, inputs) };
+        
+        template<auto p, std::unsigned_integral IntType, std::size_t first, auto inputs, std::size_t... is>
+        consteval std::array<IntType, sizeof...(is)> segment(std::index_sequence<is...>)
+        {
+            return { entry<p, IntType, first + is, inputs>... };
+        }
+        
+        //  Where a shard placed its segment of a table. Both are declared
+        //  with the alignment of their type, which stops the compiler from
+        //  raising it and leaving gaps between the shards in a section.
+        template<typename IntType>
+        struct tableSegment
+        {
+            std::size_t first;
+            std::size_t count;
+            const IntType* entries;
+        };
+        
+        //  Checks that the segments between start and stop hold exactly size
+        //  entries, which together cover the table without gaps or overlaps.
+        //  If every segment was linked at the position of its first entry,
+        //  the linked table is returned. Otherwise the segments are copied
+        //  into buffer in order.
+        template<typename IntType, std::size_t size>
+        std::span<const IntType, size> linkedTable(const IntType* start, const IntType* stop,
+                                                   std::span<const tableSegment<IntType>> segments,
+                                                   std::span<IntType, size> buffer)
+        {
+            if (stop - start != static_cast<std::ptrdiff_t>(size))
+                throw std::length_error("table segments are missing or not contiguous");
+            
+            std::vector<tableSegment<IntType>> sorted(segments.begin(), segments.end());
+            std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            
+            std::size_t next{ 0 };
+            bool inOrder{ true };
+            
+            for (const auto& s : sorted)
+            {
+                if (s.first != next || s.count > size - next)
+                    throw std::length_error("table segments overlap or leave gaps");
+                
+                next += s.count;
+                inOrder = inOrder && s.entries == start + s.first;
+            }
+            
+            if (next != size)
+                throw std::length_error("table segments are missing or not contiguous");
+            
+            if (inOrder)
+                return std::span<const IntType, size>{ start, size };
+            
+            for (const auto& s : sorted)
+                std::copy_n(s.entries, s.count, buffer.begin() + static_cast<std::ptrdiff_t>(s.first));
+            
+            return buffer;
+        }
+    }
+    
+    //  Evaluates the entries first to first + count - 1 of a table, where the
+    //  entry at index i is the final value of R0 after executing p from the
+    //  registers set by inputs(i, registers). By default, i is put in R1.
+    template<auto p, std::unsigned_integral IntType, std::size_t first, std::size_t count,
+             auto inputs = impl::indexInput{}>
+    [[maybe_unused]] [[nodiscard]]
+    consteval std::array<IntType, count> tabulate()
+    {
+        return impl::segment<p, IntType, first, inputs>(std::make_index_sequence<count>{});
+    }
+}
+
+#if defined(__ELF__)
+
+//  Defines the segment of the table name holding the entries first to
+//  first + count - 1 (see ctrm::tabulate()). A shard defines one segment.
+#define CTRM_TABLE_SEGMENT(name, program, type, first, count, ...)                                                  \
+    [[gnu::used, gnu::section("ctrm_table_" #name)]] alignas(type)                                                  \
+    constexpr std::array<type, count> ctrm_table_##name##_segment{                                                  \
+            ctrm::tabulate<program, type, first, count __VA_OPT__(,) __VA_ARGS__>() };                              \
+    [[gnu::used, gnu::section("ctrm_index_" #name)]] alignas(ctrm::impl::tableSegment<type>)                        \
+    constexpr ctrm::impl::tableSegment<type> ctrm_index_##name##_segment{                                           \
+            first, count, ctrm_table_##name##_segment.data() };
+
+//  Declares name() returning the table as a std::span of size entries.
+//  Throws std::length_error if the linked segments do not hold exactly size
+//  entries, or overlap or leave gaps.
+#define CTRM_TABLE(name, type, size)                                                                                \
+    extern "C" const type __start_ctrm_table_##name[];                                                              \
+    extern "C" const type __stop_ctrm_table_##name[];                                                               \
+    extern "C" const ctrm::impl::tableSegment<type> __start_ctrm_index_##name[];                                    \
+    extern "C" const ctrm::impl::tableSegment<type> __stop_ctrm_index_##name[];                                     \
+                                                                                                                    \
+    inline std::span<const type, size> name()                                                                       \
+    {                                                                                                               \
+        static std::array<type, size> buffer;                                                                       \
+        static const auto table{ ctrm::impl::linkedTable<type, size>(                                               \
+                __start_ctrm_table_##name, __stop_ctrm_table_##name,                                                \
+                { __start_ctrm_index_##name, __stop_ctrm_index_##name }, buffer) };                                 \
+        return table;                                                                                               \
+    }
+
+#else
+#error "ctrm/tabulate.hpp requires an ELF linker"
+#endif
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_TABULATE_HPP
@@ -0,0 +1,235 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_TRACE_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_TRACE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//  Spans are only recorded when CTRM_TRACE is defined before this header is
+//  included. Otherwise spans are empty objects and nothing is recorded.
+//
+//  Each thread records into its own buffer without taking any locks, so the
+//  trace must only be written or cleared once the traced work has finished.
+//  The output is in the Chrome trace event format, and can be opened with
+//  Perfetto (ui.perfetto.dev) or chrome://tracing.
+namespace ctrm::trace
+{
+    namespace impl
+    {
+        //  A completed span. Names and categories must be string literals,
+        //  or otherwise outlive the trace.
+        struct event
+        {
+            const char* name;
+            const char* category;
+            std::uint64_t start;
+            std::uint64_t duration;
+        };
+        
+        struct buffer
+        {
+            std::size_t id;
+            std::string name;
+            std::deque<event> events;
+        };
+        
+        //  Owns the buffer of every thread which has recorded a span. Buffers
+        //  outlive their threads so that spans from workers which have since
+        //  exited are still written. Intentionally leaked for the same reason.
+        class registry
+        {
+        private:
+            std::mutex mutex;
+            std::vector<std::unique_ptr<buffer>> buffers;
+            
+        public:
+            const std::chrono::steady_clock::time_point epoch{ std::chrono::steady_clock::now() };
+            
+            static registry& instance()
+            {
+                static registry* r{ new registry };
+                return *r;
+            }
+            
+            buffer* create()
+            {
+                const std::lock_guard lock{ mutex };
+                buffers.push_back(std::make_unique<buffer>(buffer{ buffers.size() + 1, {}, {} }));
+                return buffers.back().get();
+            }
+            
+            template<typename Function>
+            void forEach(Function f)
+            {
+                const std::lock_guard lock{ mutex };
+                
+                for (auto& b : buffers)
+                    f(*b);
+            }
+        };
+        
+        inline buffer& localBuffer()
+        {
+            thread_local buffer* b{ registry::instance().create() };
+            return *b;
+        }
+        
+        inline std::uint64_t now()
+        {
+            const auto elapsed{ std::chrono::steady_clock::now() - registry::instance().epoch };
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+        
+        inline void writeString(std::ostream& out, const std::string_view s)
+        {
+            out << '"';
+            
+            for (const char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    out << '\\' << c;
+                else if (static_cast<unsigned char>(c) >= 0x20)
+                    out << c;
+            }
+            
+            out << '"';
+        }
+        
+        inline void writeMicroseconds(std::ostream& out, std::uint64_t ns)
+        {
+            out << ns / 1000 << '.' << static_cast<char>('0' + ns / 100 % 10)
+                << static_cast<char>('0' + ns / 10 % 10) << static_cast<char>('0' + ns % 10);
+        }
+    }
+    
+#ifdef CTRM_TRACE
+    //  The recording functions live in an inline namespace named after
+    //  whether tracing is enabled, so that translation units built with and
+    //  without CTRM_TRACE never share a definition.
+    inline namespace enabled
+    {
+        //  Records the lifetime of the span as a complete event on the
+        //  calling thread's timeline.
+        class span
+        {
+        private:
+            const char* name;
+            const char* category;
+            std::uint64_t start{ impl::now() };
+        
+        public:
+            explicit span(const char* spanName, const char* spanCategory = "ctrm") :
+                    name{ spanName },
+                    category{ spanCategory }
+            {
+            }
+            
+            span(const span&) = delete;
+            span& operator=(const span&) = delete;
+            
+            ~span()
+            {
+                const std::uint64_t end{ impl::now() };
+                impl::localBuffer().events.push_back({ name, category, start, end - start });
+            }
+        };
+        
+        //  Names the calling thread's timeline in the trace, e.g. "worker 3".
+        inline void nameThread(std::string name)
+        {
+            impl::localBuffer().name = std::move(name);
+        }
+    }
+#else
+    //  Without CTRM_TRACE, spans never read the clock and nothing is
+    //  recorded.
+    inline namespace disabled
+    {
+        class span
+        {
+        public:
+            explicit span(const char*, const char* = "ctrm")
+            {
+            }
+            
+            span(const span&) = delete;
+            span& operator=(const span&) = delete;
+        };
+        
+        inline void nameThread(std::string)
+        {
+        }
+    }
+#endif
+    
+    //  Discards every span recorded so far.
+    inline void clear()
+    {
+        impl::registry::instance().forEach([](impl::buffer& b) { b.events.clear(); });
+    }
+    
+    //  Writes every span recorded so far as Chrome trace event JSON.
+    inline void write(std::ostream& out)
+    {
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first{ true };
+        
+        impl::registry::instance().forEach([&](const impl::buffer& b) {
+            if (!b.name.empty())
+            {
+                out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << b.id
+                    << ",\"args\":{\"name\":";
+                impl::writeString(out, b.name);
+                out << "}}";
+                first = false;
+            }
+            
+            for (const auto& e : b.events)
+            {
+                out << (first ? "" : ",") << "\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << b.id << ",\"name\":";
+                impl::writeString(out, e.name);
+                out << ",\"cat\":";
+                impl::writeString(out, e.category);
+                out << ",\"ts\":";
+                impl::writeMicroseconds(out, e.start);
+                out << ",\"dur\":";
+                impl::writeMicroseconds(out, e.duration);
+                out << '}';
+                first = false;
+            }
+        });
+        
+        out << "\n]}\n";
+    }
+    
+    //  Writes the trace to a file. Returns false on failure.
+    inline bool writeFile(const std::string& path)
+    {
+        std::ofstream file{ path, std::ios::trunc };
+        write(file);
+        return static_cast<bool>(file.flush());
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_TRACE_HPP
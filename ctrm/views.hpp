@@ -0,0 +1,224 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+#ifndef COMPILE_TIME_REGISTER_MACHINE_VIEWS_HPP
+#define COMPILE_TIME_REGISTER_MACHINE_VIEWS_HPP
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "runtime.hpp"
+
+//  A range adaptor which executes an image once for each element of a
+//  range, lazily:
+//
+//      for (auto result : inputs | ctrm::views::evaluate(p)) ...
+//
+//  Each element holds the initial registers of one execution, as a tuple,
+//  a range of integers or a single integer, and the result is the final
+//  value of the first register. Elements are pulled and executed in chunks
+//  as one batch, so that downstream adaptors such as std::views::take_while
+//  only cause the chunks they reach to be executed.
+namespace ctrm
+{
+    namespace impl
+    {
+        //  Copies the initial registers of one execution into a row.
+        template<typename Row>
+        void loadRow(Row&& row, std::span<std::uint64_t> registers)
+        {
+            if constexpr (std::convertible_to<Row, std::uint64_t>)
+            {
+                registers[0] = static_cast<std::uint64_t>(row);
+            }
+            else if constexpr (std::ranges::input_range<Row>)
+            {
+                std::size_t i{ 0 };
+                
+                for (auto&& value : row)
+                {
+                    if (i == registers.size())
+                        throw std::length_error("not enough registers for input");
+                    
+                    registers[i++] = static_cast<std::uint64_t>(value);
+                }
+            }
+            else
+            {
+                std::apply([&](auto&&... values) {
+                    if (sizeof...(values) > registers.size())
+                        throw std::length_error("not enough registers for input");
+                    
+                    std::size_t i{ 0 };
+                    ((registers[i++] = static_cast<std::uint64_t>(values)), ...);
+                }, std::forward<Row>(row));
+            }
+        }
+        
+        struct evaluateOptions
+        {
+            std::shared_ptr<const image> program;
+            std::size_t chunk;
+            std::size_t fuel;
+            unsigned threads;
+        };
+    }
+    
+    //  The view returned by views::evaluate(). It is an input range, as the
+    //  current chunk is held by the view. The buffers for a chunk are
+    //  allocated by begin(), so iterating does not allocate, unless the
+    //  chunks are executed on more than one thread.
+    template<std::ranges::view V>
+    requires std::ranges::input_range<V>
+    class evaluateView : public std::ranges::view_interface<evaluateView<V>>
+    {
+    private:
+        V base;
+        impl::evaluateOptions options;
+        std::vector<std::uint64_t> registers;
+        std::ranges::iterator_t<V> next;
+        std::size_t rows{ 0 };
+        std::size_t row{ 0 };
+        
+        //  Pulls and executes the next chunk of elements.
+        void fill()
+        {
+            const std::size_t stride{ options.program->registerCount };
+            std::fill(registers.begin(), registers.end(), 0);
+            row = 0;
+            
+            for (rows = 0; rows < options.chunk && next != std::ranges::end(base); ++next, ++rows)
+                impl::loadRow(*next, std::span{ registers }.subspan(rows * stride, stride));
+            
+            if (rows != 0)
+                runBatch<std::uint64_t>(*options.program, std::span{ registers }.first(rows * stride), stride,
+                                        options.fuel, options.threads);
+        }
+        
+        class iterator
+        {
+        private:
+            evaluateView* parent{ nullptr };
+        
+        public:
+            using value_type = std::uint64_t;
+            using difference_type = std::ptrdiff_t;
+            
+            iterator() = default;
+            
+            explicit iterator(evaluateView* view) :
+                    parent{ view }
+            {
+            }
+            
+            std::uint64_t operator*() const
+            {
+                return parent->registers[parent->row * parent->options.program->registerCount];
+            }
+            
+            iterator& operator++()
+            {
+                if (++parent->row == parent->rows)
+                    parent->fill();
+                
+                return *this;
+            }
+            
+            void operator++(int)
+            {
+                ++*this;
+            }
+            
+            bool operator==(std::default_sentinel_t) const
+            {
+                return parent->rows == 0;
+            }
+        };
+    
+    public:
+        evaluateView(V base, impl::evaluateOptions options) :
+                base{ std::move(base) },
+                options{ std::move(options) }
+        {
+        }
+        
+        iterator begin()
+        {
+            registers.assign(options.chunk * options.program->registerCount, 0);
+            next = std::ranges::begin(base);
+            fill();
+            return iterator{ this };
+        }
+        
+        std::default_sentinel_t end() const
+        {
+            return std::default_sentinel;
+        }
+    };
+    
+    namespace views
+    {
+        //  Adaptor returned by evaluate(), which applies to a range with |.
+        struct evaluateAdaptor
+        {
+            impl::evaluateOptions options;
+            
+            template<std::ranges::viewable_range R>
+            requires std::ranges::input_range<R>
+            auto operator()(R&& range) const
+            {
+                return evaluateView{ std::views::all(std::forward<R>(range)), options };
+            }
+            
+            template<std::ranges::viewable_range R>
+            requires std::ranges::input_range<R>
+            friend auto operator|(R&& range, const evaluateAdaptor& adaptor)
+            {
+                return adaptor(std::forward<R>(range));
+            }
+        };
+        
+        //  Executes an image for each element of a range, chunk elements at
+        //  a time, on the given number of threads (see runBatch()). Throws
+        //  std::length_error if the image has fewer registers than an
+        //  element while iterating.
+        [[maybe_unused]] [[nodiscard]]
+        inline evaluateAdaptor evaluate(image p, std::size_t chunk = 256,
+                                        std::size_t fuel = std::numeric_limits<std::size_t>::max(), unsigned threads = 1)
+        {
+            p.check();
+            return { { std::make_shared<const image>(std::move(p)), std::max<std::size_t>(chunk, 1), fuel, threads } };
+        }
+        
+        template<std::size_t maxRegisters, std::size_t instrCount>
+        [[maybe_unused]] [[nodiscard]]
+        evaluateAdaptor evaluate(const program<maxRegisters, instrCount>& p, std::size_t chunk = 256,
+                                 std::size_t fuel = std::numeric_limits<std::size_t>::max(), unsigned threads = 1)
+        {
+            return evaluate(image{ p }, chunk, fuel, threads);
+        }
+    }
+}
+
+#endif //  COMPILE_TIME_REGISTER_MACHINE_VIEWS_HPP
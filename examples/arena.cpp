@@ -0,0 +1,48 @@
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <string>
+
+#include "../ctrm/arena.hpp"
+
+//  Loads a thousand programs into a registry, each adding a different
+//  constant, then handles requests which execute one of them on registers
+//  from the thread's scratch arena. Prints the number of programs, the sum
+//  of the results, and whether the scratch arena stopped growing after the
+//  first request.
+int main()
+{
+    ctrm::registry programs;
+    
+    for (std::size_t n{ 0 }; n < 1000; ++n)
+    {
+        std::string text{ "L0 : R1- -> L1, L2\nL1 : R0+ -> L0\n" };
+        
+        for (std::size_t i{ 0 }; i < n % 8; ++i)
+            text += 'L' + std::to_string(i + 2) + " : R0+ -> L" + std::to_string(i + 3) + '\n';
+        
+        text += 'L' + std::to_string(n % 8 + 2) + " : HALT";
+        programs.load("add" + std::to_string(n), text);
+    }
+    
+    std::uint64_t total{ 0 };
+    std::size_t capacity{ 0 };
+    
+    for (std::size_t request{ 0 }; request < 10000; ++request)
+    {
+        const ctrm::scratchScope scope;
+        const auto& program{ *programs.find("add" + std::to_string(request % 1000)) };
+        auto registers{ ctrm::scratchRegisters<std::uint64_t>(program.registerCount) };
+        
+        registers[1] = request;
+        static_cast<void>(ctrm::run<std::uint64_t>(program, registers));
+        total += registers[0];
+        
+        if (request == 0)
+            capacity = ctrm::scratch().capacity();
+    }
+    
+    std::cout << programs.size() << ' ' << total << ' ' << (ctrm::scratch().capacity() == capacity) << '\n';
+    return 0;
+}
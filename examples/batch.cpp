@@ -0,0 +1,59 @@
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "../ctrm/runtime.hpp"
+
+//  Executes a batch of multiplications, with many repeated rows and a fuel
+//  limit which some rows run out of, with every combination of
+//  deduplication and cost ordering on one and four threads. Each row has a
+//  fifth register the program does not use, which must be left alone.
+//  Prints the number of rows, the number which ran out of fuel, and the
+//  number of combinations which matched a plain batch in every register
+//  and in the status.
+int main()
+{
+    const auto p{ ctrm::load(
+            "L0 : R1- -> L1, L6\n"
+            "L1 : R2- -> L2, L4\n"
+            "L2 : R0+ -> L3\n"
+            "L3 : R3+ -> L1\n"
+            "L4 : R3- -> L5, L0\n"
+            "L5 : R2+ -> L4\n"
+            "L6 : HALT") };
+    
+    constexpr std::size_t rows{ 10000 };
+    constexpr std::size_t stride{ 5 };
+    constexpr std::size_t fuel{ 1000 };
+    std::vector<std::uint64_t> initial(rows * stride);
+    
+    for (std::size_t row{ 0 }; row < rows; ++row)
+    {
+        initial[row * stride + 1] = row % 37;
+        initial[row * stride + 2] = row % 23;
+        initial[row * stride + 4] = row;
+    }
+    
+    auto expected{ initial };
+    const auto plain{ ctrm::runBatch<std::uint64_t>(p, expected, stride, fuel, 1) };
+    std::size_t matches{ 0 };
+    
+    for (const unsigned threads : { 1u, 4u })
+    {
+        for (const bool deduplicate : { false, true })
+        {
+            for (const bool costOrder : { false, true })
+            {
+                auto values{ initial };
+                const auto s{ ctrm::runBatch<std::uint64_t>(p, values, stride,
+                                                            { fuel, threads, deduplicate, costOrder }) };
+                matches += values == expected && s.runs == plain.runs && s.steps == plain.steps
+                           && s.exhausted == plain.exhausted;
+            }
+        }
+    }
+    
+    std::cout << plain.runs << ' ' << plain.exhausted << ' ' << matches << '\n';
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../ctrm/ctrm.h"
+
+int main(void)
+{
+    const char* text = "L0 : R1- -> L1, L2\n"
+                       "L1 : R0+ -> L0\n"
+                       "L2 : R2- -> L3, L4\n"
+                       "L3 : R0+ -> L2\n"
+                       "L4 : HALT";
+    
+    ctrm_program* program;
+    if (ctrm_load_text(text, strlen(text), &program) != CTRM_OK)
+    {
+        fprintf(stderr, "%s\n", ctrm_last_error());
+        return 1;
+    }
+    
+    uint64_t registers[4][3] = { { 0, 1, 2 }, { 0, 3, 5 }, { 0, 10, 20 }, { 0, 100, 200 } };
+    ctrm_stats stats;
+    ctrm_run_batch(program, &registers[0][0], 3, 4, 0, &stats);
+    
+    for (int i = 0; i < 4; ++i)
+        printf("%" PRIu64 "\n", registers[i][0]);
+    
+    /*  Invalid arguments are reported rather than executed */
+    if (ctrm_run(program, NULL, 3, NULL) == CTRM_INVALID_ARGUMENT)
+        printf("%s\n", ctrm_last_error());
+    
+    if (ctrm_run_batch(program, &registers[0][0], 3, SIZE_MAX, 1, NULL) == CTRM_INVALID_ARGUMENT)
+        printf("%s\n", ctrm_last_error());
+    
+    ctrm_set_fuel(NULL, 10);
+    printf("%zu %zu\n", ctrm_register_count(NULL), ctrm_save_binary(NULL, NULL, 0));
+    
+    ctrm_free(program);
+    return 0;
+}
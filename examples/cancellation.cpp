@@ -0,0 +1,56 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CTRM_METRICS
+#include "../ctrm/runtime.hpp"
+
+//  Executes a program which would take hours, as its loop is too long to be
+//  executed in constant time: once until another thread requests a stop,
+//  once with a deadline which has already passed, and once with too little
+//  fuel. Then executes it to completion with a stop token which is never
+//  used. Prints whether each execution was cancelled, followed by how far it
+//  got, and then the metrics.
+int main()
+{
+    std::string text{ "L0 : R1- -> L1, L4097\n" };
+    
+    for (std::size_t i{ 1 }; i <= 4096; ++i)
+        text += 'L' + std::to_string(i) + " : R0+ -> L" + std::to_string(i == 4096 ? 0 : i + 1) + '\n';
+    
+    const auto p{ ctrm::load(text + "L4097 : HALT") };
+    constexpr std::uint64_t forever{ std::uint64_t{ 1 } << 40 };
+    
+    std::vector<std::uint64_t> values{ 0, forever };
+    std::stop_source source;
+    std::jthread canceller{ [&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+        source.request_stop();
+    } };
+    
+    const auto stopped{ ctrm::run<std::uint64_t>(p, std::span{ values }, source.get_token()) };
+    std::cout << stopped.cancelled << ' ' << stopped.halted << ' ' << (values[0] > 0) << '\n';
+    
+    values = { 0, forever };
+    const auto past{ std::chrono::steady_clock::now() - std::chrono::seconds{ 1 } };
+    const auto late{ ctrm::run<std::uint64_t>(p, std::span{ values }, past) };
+    std::cout << late.cancelled << ' ' << late.steps << '\n';
+    
+    values = { 0, forever };
+    const auto exhausted{ ctrm::run<std::uint64_t>(p, std::span{ values }, std::stop_token{},
+                                                   std::chrono::steady_clock::time_point::max(), 5000) };
+    std::cout << exhausted.cancelled << ' ' << exhausted.steps << '\n';
+    
+    values = { 0, 3 };
+    const std::stop_source unused;
+    const auto complete{ ctrm::run<std::uint64_t>(p, std::span{ values }, unused.get_token()) };
+    std::cout << complete.cancelled << ' ' << complete.halted << ' ' << values[0] << '\n';
+    
+    ctrm::metrics::write(std::cout);
+    return 0;
+}
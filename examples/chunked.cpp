@@ -0,0 +1,26 @@
+#include <cstdint>
+#include <iostream>
+
+#include "../ctrm.hpp"
+
+//  Sums 0 to 9999 at compile time. Executing this in a single constant
+//  evaluation with exec() exceeds GCC's default -fconstexpr-ops-limit, so
+//  it is executed in chunks of ten million steps instead. Prints the result,
+//  and the number of steps and chunks used.
+constexpr auto triangle{ ctrm::make<3, 7>(
+        "L0 : R1- -> L1, L6\n"
+        "L1 : R1- -> L2, L4\n"
+        "L2 : R2+ -> L3\n"
+        "L3 : R0+ -> L1\n"
+        "L4 : R2- -> L5, L0\n"
+        "L5 : R1+ -> L4\n"
+        "L6 : HALT") };
+
+constexpr auto sum{ ctrm::execChunked<triangle, 10'000'000, std::uint64_t, 0, 10'000> };
+static_assert(sum.halted && sum.values[0] == 49'995'000);
+
+int main()
+{
+    std::cout << sum.values[0] << ' ' << sum.steps << ' ' << sum.chunks << '\n';
+    return 0;
+}
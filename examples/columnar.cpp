@@ -0,0 +1,75 @@
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include "../ctrm/columnar.hpp"
+
+//  Encodes a sweep over the inputs of a multiplication in the columnar
+//  format, then decodes it a block at a time, executes each block and
+//  encodes the results. Prints how much smaller both are than raw 64-bit
+//  registers, and the number of results which are correct.
+int main()
+{
+    const ctrm::image multiply{ ctrm::make<4, 7>(
+            "L0 : R1- -> L1, L6\n"
+            "L1 : R2- -> L2, L4\n"
+            "L2 : R0+ -> L3\n"
+            "L3 : R3+ -> L1\n"
+            "L4 : R3- -> L5, L0\n"
+            "L5 : R2+ -> L4\n"
+            "L6 : HALT") };
+    
+    constexpr std::size_t columns{ 4 };
+    constexpr std::size_t blockSize{ 8192 };
+    constexpr std::size_t rows{ 100'000 };
+    
+    //  Write the inputs, a block at a time
+    std::vector<std::byte> inputs;
+    std::vector<std::uint64_t> block(columns * blockSize, 0);
+    ctrm::writeColumnarHeader(inputs, columns);
+    
+    for (std::size_t first{ 0 }; first < rows; first += blockSize)
+    {
+        const std::size_t count{ std::min(blockSize, rows - first) };
+        
+        for (std::size_t row{ 0 }; row < count; ++row)
+        {
+            block[1 * blockSize + row] = (first + row) / 100;
+            block[2 * blockSize + row] = (first + row) % 100;
+        }
+        
+        ctrm::encodeBlock(inputs, block, columns, count, blockSize);
+    }
+    
+    //  Decode each block, execute its rows and write the results
+    std::vector<std::byte> results;
+    std::vector<std::uint64_t> registers(columns * blockSize);
+    std::size_t correct{ 0 };
+    ctrm::writeColumnarHeader(results, 1);
+    
+    const std::span<const std::byte> data{ inputs };
+    
+    for (std::size_t offset{ ctrm::readColumnarHeader(data) == columns ? 8u : data.size() }; offset < data.size();)
+    {
+        const std::size_t count{ ctrm::blockRows(data.subspan(offset)) };
+        offset += ctrm::decodeBlock(data.subspan(offset), block, columns, blockSize);
+        
+        for (std::size_t row{ 0 }; row < count; ++row)
+            for (std::size_t c{ 0 }; c < columns; ++c)
+                registers[row * columns + c] = block[c * blockSize + row];
+        
+        ctrm::runBatch<std::uint64_t>(multiply, std::span{ registers }.first(count * columns), columns);
+        
+        for (std::size_t row{ 0 }; row < count; ++row)
+        {
+            block[row] = registers[row * columns];
+            correct += block[row] == block[blockSize + row] * block[2 * blockSize + row];
+        }
+        
+        ctrm::encodeBlock(results, block, 1, count, blockSize);
+    }
+    
+    std::cout << rows * columns * 8 / inputs.size() << "x " << rows * 8 / results.size() << "x " << correct << '\n';
+    return 0;
+}
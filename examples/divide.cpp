@@ -0,0 +1,24 @@
+#include <iostream>
+
+#include "../ctrm.hpp"
+
+//  Divides R1 by R2 by repeatedly subtracting R2 from R1, which takes over
+//  three steps for every unit of R1. Both loops are executed in constant
+//  time, so this is evaluated at compile time even for large dividends.
+int main()
+{
+    constexpr auto divide{ ctrm::make<4, 7>(
+            "L0 : R2- -> L1, L2\n"
+            "L1 : R3+ -> L0\n"
+            "L2 : R3- -> L3, L5\n"
+            "L3 : R1- -> L4, L6\n"
+            "L4 : R2+ -> L2\n"
+            "L5 : R0+ -> L0\n"
+            "L6 : HALT") };
+    
+    constexpr auto result{ divide.exec<unsigned long long>(0, 1'000'000'000'000ULL, 7) };
+    static_assert(result == 142'857'142'857ULL);
+    
+    std::cout << result << '\n';
+    return 0;
+}
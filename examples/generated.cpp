@@ -0,0 +1,13 @@
+#include <iostream>
+
+//  Generated from multiply.rm by ctrm_add_program() in CMakeLists.txt
+#include "multiply.hpp"
+
+int main()
+{
+    constexpr auto result{ multiply.exec(0, 6, 7) };
+    static_assert(ctrm::result_v<multiply, 0, 6, 7> == result);
+    
+    std::cout << result << '\n';
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "../ctrm/hugepages.hpp"
+#include "../ctrm/runtime.hpp"
+
+//  Allocates batch registers filling two huge pages and a large image
+//  through a resource for each mode, executes the batch and frees both.
+//  Without huge pages configured, explicit huge pages fall back to
+//  transparent ones and those to ordinary pages. For each mode, prints
+//  whether the bytes mapped for the registers add up to two huge pages,
+//  whether the image was mapped as well, whether no mode better than the
+//  one asked for was used, and whether the batch gave the right results.
+int main()
+{
+    const std::size_t page{ ctrm::impl::hugePageSize() };
+    std::string text{ "L0 : R1- -> L1, L2\nL1 : R0+ -> L0\nL2 : HALT" };
+    
+    //  Unreachable lines, which make the image at least half a huge page
+    for (std::size_t line{ 3 }; line * sizeof(ctrm::impl::instruction) < page / 2; ++line)
+        text += "\nL" + std::to_string(line) + " : HALT";
+    
+    for (const auto mode : { ctrm::SMALL_PAGES, ctrm::TRANSPARENT_HUGE_PAGES, ctrm::EXPLICIT_HUGE_PAGES })
+    {
+        ctrm::hugePageResource pages{ mode };
+        const auto mapped{ [&] {
+            return pages.mapped(ctrm::SMALL_PAGES) + pages.mapped(ctrm::TRANSPARENT_HUGE_PAGES)
+                   + pages.mapped(ctrm::EXPLICIT_HUGE_PAGES);
+        } };
+        
+        bool registersMapped;
+        bool imageMapped;
+        bool correct;
+        
+        {
+            const std::size_t rows{ page / 8 };
+            std::pmr::vector<std::uint64_t> registers(rows * 2, &pages);
+            registersMapped = mapped() == 2 * page;
+            
+            for (std::size_t row{ 0 }; row < rows; ++row)
+                registers[row * 2 + 1] = row;
+            
+            const auto p{ ctrm::load(text, &pages) };
+            imageMapped = mapped() > 2 * page;
+            const auto s{ ctrm::runBatch<std::uint64_t>(p, registers, 2, std::numeric_limits<std::size_t>::max(), 1) };
+            correct = s.exhausted == 0;
+            
+            for (std::size_t row{ 0 }; row < rows; ++row)
+                correct = correct && registers[row * 2] == row;
+        }
+        
+        const bool asked{ (mode >= ctrm::TRANSPARENT_HUGE_PAGES || pages.mapped(ctrm::TRANSPARENT_HUGE_PAGES) == 0)
+                          && (mode == ctrm::EXPLICIT_HUGE_PAGES || pages.mapped(ctrm::EXPLICIT_HUGE_PAGES) == 0) };
+        
+        std::cout << registersMapped << ' ' << imageMapped << ' ' << asked << ' ' << correct << '\n';
+    }
+    
+    return 0;
+}
@@ -0,0 +1,24 @@
+#include <iostream>
+
+#define CTRM_METRICS
+#include "../ctrm/runtime.hpp"
+
+int main()
+{
+    constexpr auto register_machine { ctrm::make<3, 5>(
+            "L0 : R1- -> L1, L2\n"
+            "L1 : R0+ -> L0\n"
+            "L2 : R2- -> L3, L4\n"
+            "L3 : R0+ -> L2\n"
+            "L4 : HALT") };
+    
+    //  Two loops, one after the other, so the steps grow linearly
+    static_assert(register_machine.stats().loops == 2 && register_machine.stats().cost == ctrm::LINEAR);
+    ctrm::metrics::describe("add", register_machine.stats());
+    
+    for (std::size_t i{ 0 }; i < 100; ++i)
+        std::cout << ctrm::run(register_machine, 0, i, 2 * i) << '\n';
+    
+    ctrm::metrics::write(std::cout);
+    return 0;
+}
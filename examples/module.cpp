@@ -0,0 +1,27 @@
+#include <cstdio>
+
+import ctrm;
+
+using namespace ctrm::literals;
+
+//  Multiplies R1 by R2 into R0, using R3 to restore R2
+static constexpr auto multiply{ "L0 : R1- -> L1, L6\n"
+                                "L1 : R2- -> L2, L4\n"
+                                "L2 : R0+ -> L3\n"
+                                "L3 : R3+ -> L1\n"
+                                "L4 : R3- -> L5, L0\n"
+                                "L5 : R2+ -> L4\n"
+                                "L6 : HALT"_ctrm };
+
+//  Uses the ctrm module instead of the header: the program is parsed by the
+//  _ctrm literal, and executed at compile time both in one evaluation and in
+//  chunks. The register type is given explicitly, as GCC 12 drops the default
+//  across module boundaries.
+int main()
+{
+    constexpr auto product{ multiply.exec<unsigned long long>(0, 6, 7) };
+    constexpr auto chunked{ ctrm::execChunked<multiply, 50, unsigned long long, 0, 6, 7> };
+    
+    std::printf("%llu %llu %zu\n", product, chunked.values[0], chunked.chunks);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include <iostream>
+
+#include "../ctrm/optimise.hpp"
+
+int main()
+{
+    //  Both branches of the program end with the same two increments and a
+    //  halt, which are merged into a single copy.
+    constexpr auto p{ ctrm::make<2, 7>(
+            "L0 : R1- -> L1, L4\n"
+            "L1 : R0+ -> L2\n"
+            "L2 : R0+ -> L3\n"
+            "L3 : HALT\n"
+            "L4 : R0+ -> L5\n"
+            "L5 : R0+ -> L6\n"
+            "L6 : HALT") };
+    
+    constexpr auto merged{ ctrm::merge<ctrm::mergedCount(p)>(p) };
+    static_assert(merged.exec(0, 5) == p.exec(0, 5));
+    
+    //  Adds R1 and R2 by moving each onto a temporary, and then each
+    //  temporary onto R0. Both temporaries are removed.
+    constexpr auto add{ ctrm::make<5, 9>(
+            "L0 : R1- -> L1, L2\n"
+            "L1 : R3+ -> L0\n"
+            "L2 : R2- -> L3, L4\n"
+            "L3 : R4+ -> L2\n"
+            "L4 : R3- -> L5, L6\n"
+            "L5 : R0+ -> L4\n"
+            "L6 : R4- -> L7, L8\n"
+            "L7 : R0+ -> L6\n"
+            "L8 : HALT") };
+    
+    constexpr auto addShape{ ctrm::propagatedShape(add, 3) };
+    constexpr auto direct{ ctrm::propagate<addShape>(add, 3) };
+    static_assert(addShape.registers == 3 && direct.exec(0, 4, 5) == add.exec(0, 4, 5));
+    
+    //  Copies R1 to R0 through two temporaries, one of which restores R1.
+    //  The copy is made straight to R0, and only one temporary is left.
+    constexpr auto copy{ ctrm::make<4, 8>(
+            "L0 : R1- -> L1, L3\n"
+            "L1 : R2+ -> L2\n"
+            "L2 : R3+ -> L0\n"
+            "L3 : R3- -> L4, L5\n"
+            "L4 : R1+ -> L3\n"
+            "L5 : R2- -> L6, L7\n"
+            "L6 : R0+ -> L5\n"
+            "L7 : HALT") };
+    
+    constexpr auto copyShape{ ctrm::propagatedShape(copy, 2) };
+    constexpr auto copied{ ctrm::propagate<copyShape>(copy, 2) };
+    static_assert(copyShape.registers == 3 && copied.exec(0, 6) == copy.exec(0, 6));
+    
+    std::cout << p.instructionCount << ' ' << merged.instructionCount << '\n'
+              << add.instructionCount << ' ' << direct.instructionCount << '\n'
+              << copy.instructionCount << ' ' << copied.instructionCount << '\n';
+    return 0;
+}
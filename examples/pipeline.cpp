@@ -0,0 +1,65 @@
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <vector>
+
+#include "../ctrm/pipeline.hpp"
+
+//  Adds a and b, then feeds the sum to two stages: one squaring it and one
+//  doubling it. Prints the number of rows from each which are correct.
+int main()
+{
+    const ctrm::image add{ ctrm::make<3, 5>(
+            "L0 : R1- -> L1, L2\n"
+            "L1 : R0+ -> L0\n"
+            "L2 : R2- -> L3, L4\n"
+            "L3 : R0+ -> L2\n"
+            "L4 : HALT") };
+    
+    const ctrm::image multiply{ ctrm::make<4, 7>(
+            "L0 : R1- -> L1, L6\n"
+            "L1 : R2- -> L2, L4\n"
+            "L2 : R0+ -> L3\n"
+            "L3 : R3+ -> L1\n"
+            "L4 : R3- -> L5, L0\n"
+            "L5 : R2+ -> L4\n"
+            "L6 : HALT") };
+    
+    const ctrm::image twice{ ctrm::make<2, 4>(
+            "L0 : R1- -> L1, L3\n"
+            "L1 : R0+ -> L2\n"
+            "L2 : R0+ -> L0\n"
+            "L3 : HALT") };
+    
+    ctrm::pipeline pipeline;
+    const std::size_t sum{ pipeline.add(add) };
+    const std::size_t square{ pipeline.add(multiply) };
+    const std::size_t doubled{ pipeline.add(twice) };
+    pipeline.connect(sum, square, { { 0, 1 }, { 0, 2 } });
+    pipeline.connect(sum, doubled, { { 0, 1 } });
+    
+    constexpr std::size_t rows{ 10'000 };
+    std::vector<std::uint64_t> inputs(rows * 3);
+    
+    for (std::size_t i{ 0 }; i < rows; ++i)
+    {
+        inputs[i * 3 + 1] = i % 100;
+        inputs[i * 3 + 2] = i / 100;
+    }
+    
+    //  Batches of each stage arrive in order
+    std::size_t next[3]{};
+    std::size_t correct[3]{};
+    
+    pipeline.run(inputs, 3, [&](std::size_t stage, std::span<const std::uint64_t> results, std::size_t width) {
+        for (std::size_t r{ 0 }; r < results.size() / width; ++r, ++next[stage])
+        {
+            const std::uint64_t s{ next[stage] % 100 + next[stage] / 100 };
+            correct[stage] += results[r * width] == (stage == square ? s * s : 2 * s);
+        }
+    });
+    
+    std::cout << correct[square] << ' ' << correct[doubled] << '\n';
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+
+#include "../ctrm/scheduler.hpp"
+
+//  Shares a scheduler between two tenants, one of which is only admitted
+//  programs of linear cost. Prints the result of each execution and its
+//  state: a product, a sum, a rejected multiplication, an endless loop
+//  which runs out of fuel and a program which halts without any fuel.
+int main()
+{
+    const auto multiply{ std::make_shared<const ctrm::image>(ctrm::make<4, 7>(
+            "L0 : R1- -> L1, L6\n"
+            "L1 : R2- -> L2, L4\n"
+            "L2 : R0+ -> L3\n"
+            "L3 : R3+ -> L1\n"
+            "L4 : R3- -> L5, L0\n"
+            "L5 : R2+ -> L4\n"
+            "L6 : HALT")) };
+    
+    const auto add{ std::make_shared<const ctrm::image>(ctrm::make<3, 5>(
+            "L0 : R1- -> L1, L2\n"
+            "L1 : R0+ -> L0\n"
+            "L2 : R2- -> L3, L4\n"
+            "L3 : R0+ -> L2\n"
+            "L4 : HALT")) };
+    
+    const auto endless{ std::make_shared<const ctrm::image>(ctrm::make<1, 1>("L0 : R0+ -> L0")) };
+    const auto halt{ std::make_shared<const ctrm::image>(ctrm::make<1, 1>("L0 : HALT")) };
+    
+    ctrm::scheduler scheduler;
+    const std::size_t trusted{ scheduler.addTenant({ 2, 16, ctrm::UNBOUNDED, 1'000'000 }) };
+    const std::size_t limited{ scheduler.addTenant({ 1, 16, ctrm::LINEAR }) };
+    
+    auto results{ std::array{
+            scheduler.submit(trusted, multiply, { 0, 6, 7, 0 }),
+            scheduler.submit(limited, add, { 0, 3, 4 }),
+            scheduler.submit(limited, multiply, { 0, 6, 7, 0 }),
+            scheduler.submit(trusted, endless, { 0 }),
+            scheduler.submit(limited, halt, { 5 }, 0) } };
+    
+    while (scheduler.runSlice())
+    {
+    }
+    
+    for (auto& f : results)
+    {
+        const auto r{ f.get() };
+        std::cout << r.registers[0] << ' ' << r.state << '\n';
+    }
+    
+    return 0;
+}
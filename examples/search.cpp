@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <iostream>
+#include <span>
+
+#include "../ctrm/search.hpp"
+
+//  Inverse questions about multiplication: which x gives 37x = 45658, found
+//  by bisection as the product increases with x; the first pair (a, b) with
+//  ab = 391; and the number of pairs with ab = 360, for a and b from 1 to
+//  100. Prints x and the number of candidates executed to find it, a and b,
+//  and the number of pairs.
+int main()
+{
+    const ctrm::image multiply{ ctrm::make<4, 7>(
+            "L0 : R1- -> L1, L6\n"
+            "L1 : R2- -> L2, L4\n"
+            "L2 : R0+ -> L3\n"
+            "L3 : R3+ -> L1\n"
+            "L4 : R3- -> L5, L0\n"
+            "L5 : R2+ -> L4\n"
+            "L6 : HALT") };
+    
+    const ctrm::searchDomain line{ { 1 }, { 0 }, { 1'000'000 }, { 0, 0, 37 } };
+    const ctrm::searchDomain square{ { 1, 2 }, { 1, 1 }, { 100, 100 }, {} };
+    
+    ctrm::searchOptions bisect;
+    bisect.monotone = true;
+    bisect.threads = 4;
+    
+    const auto x{ ctrm::preimage<std::uint64_t>(multiply, line, 45658, bisect) };
+    const auto pair{ ctrm::preimage<std::uint64_t>(multiply, square, 391) };
+    const auto pairs{ ctrm::findAll<std::uint64_t>(multiply, square, [](std::span<const std::uint64_t> values) {
+        return values[0] == 360;
+    }) };
+    
+    std::cout << *x.match << ' ' << x.evaluated << ' '
+              << *pair.match / 100 + 1 << ' ' << *pair.match % 100 + 1 << ' ' << pairs.matches.size() << '\n';
+    return 0;
+}
@@ -0,0 +1,43 @@
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <span>
+
+#include "../ctrm/snapshot.hpp"
+
+//  Sweeps the register added to a product, which the program only reads
+//  once the multiplication is done. Every execution after the first resumes
+//  from the snapshot taken just before that read. Prints the number of
+//  results which match run(), and the number of steps each one skips.
+int main()
+{
+    const ctrm::image program{ ctrm::make<5, 9>(
+            "L0 : R1- -> L1, L6\n"
+            "L1 : R2- -> L2, L4\n"
+            "L2 : R0+ -> L3\n"
+            "L3 : R3+ -> L1\n"
+            "L4 : R3- -> L5, L0\n"
+            "L5 : R2+ -> L4\n"
+            "L6 : R4- -> L7, L8\n"
+            "L7 : R0+ -> L6\n"
+            "L8 : HALT") };
+    
+    const std::array<std::uint64_t, 5> base{ 0, 30, 40, 0, 0 };
+    const ctrm::snapshots<std::uint64_t> sweep{ program, base };
+    std::size_t matches{ 0 };
+    
+    for (std::uint64_t addend{ 0 }; addend < 1000; ++addend)
+    {
+        std::array<std::uint64_t, 5> resumed{ 0, 30, 40, 0, addend };
+        std::array<std::uint64_t, 5> expected{ resumed };
+        
+        const auto s{ sweep.run(std::span{ resumed }) };
+        const auto t{ ctrm::run<std::uint64_t>(program, std::span{ expected }) };
+        
+        if (resumed == expected && s.steps == t.steps && resumed[0] == 1200 + addend)
+            ++matches;
+    }
+    
+    std::cout << matches << ' ' << sweep.firstRead(4) << '\n';
+    return 0;
+}
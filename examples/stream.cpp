@@ -0,0 +1,53 @@
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "../ctrm/stream.hpp"
+
+//  Streams rows of registers through a program from one temporary file to
+//  another in small chunks, once through io_uring (where the kernel allows
+//  it) and once with pread() and pwrite(), and checks every result.
+int main()
+{
+    constexpr auto add{ ctrm::make<3, 5>(
+            "L0 : R1- -> L1, L2\n"
+            "L1 : R0+ -> L0\n"
+            "L2 : R2- -> L3, L4\n"
+            "L3 : R0+ -> L2\n"
+            "L4 : HALT") };
+    
+    constexpr std::size_t rows{ 100'000 };
+    std::vector<std::uint64_t> input;
+    
+    for (std::uint64_t i{ 0 }; i < rows; ++i)
+        input.insert(input.end(), { 0, i, 2 * i });
+    
+    std::FILE* in{ std::tmpfile() };
+    std::fwrite(input.data(), sizeof(std::uint64_t), input.size(), in);
+    std::fflush(in);
+    
+    for (const bool ioUring : { true, false })
+    {
+        std::FILE* out{ std::tmpfile() };
+        ctrm::streamOptions options;
+        options.chunkRows = 4096;
+        options.ioUring = ioUring;
+        
+        const auto s{ ctrm::runStream(ctrm::image{ add }, fileno(in), fileno(out), 3, options) };
+        
+        std::vector<std::uint64_t> results(rows + 1);
+        std::rewind(out);
+        const std::size_t count{ std::fread(results.data(), sizeof(std::uint64_t), results.size(), out) };
+        std::size_t correct{ 0 };
+        
+        for (std::size_t i{ 0 }; i < count; ++i)
+            correct += results[i] == 3 * i;
+        
+        std::cout << s.runs << ' ' << correct << '\n';
+        std::fclose(out);
+    }
+    
+    std::fclose(in);
+    return 0;
+}
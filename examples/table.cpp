@@ -0,0 +1,29 @@
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+
+//  Generated by ctrm_add_table() in CMakeLists.txt, from examples/table.hpp
+#include "products.hpp"
+
+//  Checks a table of products evaluated at compile time in four shards.
+//  Prints the size of the table and the number of correct entries, or the
+//  error if the shards do not make up the table.
+int main()
+{
+    try
+    {
+        const auto table{ products() };
+        std::size_t correct{ 0 };
+        
+        for (std::size_t i{ 0 }; i < table.size(); ++i)
+            correct += table[i] == (i / 32) * (i % 32);
+        
+        std::cout << table.size() << ' ' << correct << '\n';
+    }
+    catch (const std::length_error& e)
+    {
+        std::cout << e.what() << '\n';
+    }
+    
+    return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../ctrm.hpp"
+
+//  The table of products built by ctrm_add_table() for examples/table.cpp,
+//  with the entry at index i holding (i / 32) * (i % 32).
+inline constexpr auto multiply{ ctrm::make<4, 7>(
+        "L0 : R1- -> L1, L6\n"
+        "L1 : R2- -> L2, L4\n"
+        "L2 : R0+ -> L3\n"
+        "L3 : R3+ -> L1\n"
+        "L4 : R3- -> L5, L0\n"
+        "L5 : R2+ -> L4\n"
+        "L6 : HALT") };
+
+inline constexpr auto productInputs{ [](std::size_t index, auto registers) {
+    registers[1] = index / 32;
+    registers[2] = index % 32;
+} };
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define CTRM_TRACE
+#include "../ctrm/runtime.hpp"
+
+namespace
+{
+    //  Skips one JSON value at the start of s, returning false if it is not
+    //  valid JSON.
+    bool skipValue(std::string_view& s)
+    {
+        const auto skipSpace{ [&] {
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front())))
+                s.remove_prefix(1);
+        } };
+        
+        skipSpace();
+        
+        if (s.empty())
+            return false;
+        
+        if (s.front() == '"')
+        {
+            for (s.remove_prefix(1); !s.empty() && s.front() != '"'; s.remove_prefix(1))
+                if (s.front() == '\\')
+                    s.remove_prefix(1);
+            
+            if (s.empty())
+                return false;
+            
+            s.remove_prefix(1);
+            return true;
+        }
+        
+        if (s.front() == '{' || s.front() == '[')
+        {
+            const char close{ s.front() == '{' ? '}' : ']' };
+            s.remove_prefix(1);
+            skipSpace();
+            
+            for (bool first{ true }; s.empty() || s.front() != close; first = false)
+            {
+                if (!first && (s.empty() || s.front() != ','))
+                    return false;
+                
+                if (!first)
+                    s.remove_prefix(1);
+                
+                if (close == '}')
+                {
+                    skipSpace();
+                    
+                    if (s.empty() || s.front() != '"' || !skipValue(s))
+                        return false;
+                    
+                    skipSpace();
+                    
+                    if (s.empty() || s.front() != ':')
+                        return false;
+                    
+                    s.remove_prefix(1);
+                }
+                
+                if (!skipValue(s))
+                    return false;
+                
+                skipSpace();
+            }
+            
+            s.remove_prefix(1);
+            return true;
+        }
+        
+        const std::size_t length{ s.find_first_not_of("0123456789.-+eE") };
+        
+        if (length == 0)
+            return false;
+        
+        s.remove_prefix(std::min(length, s.size()));
+        return true;
+    }
+    
+    std::size_t occurrences(std::string_view s, std::string_view pattern)
+    {
+        std::size_t count{ 0 };
+        
+        for (std::size_t at{ s.find(pattern) }; at != std::string_view::npos; at = s.find(pattern, at + 1))
+            ++count;
+        
+        return count;
+    }
+}
+
+//  Traces a single execution and a batch on four threads, with a span of its
+//  own around them on the named main thread, and writes the trace to
+//  trace.json. Prints the result of the execution, then reads the file back
+//  and prints whether it is valid JSON, the number of spans of each kind and
+//  the number of named threads.
+int main()
+{
+    constexpr auto multiply{ ctrm::make<4, 7>(
+            "L0 : R1- -> L1, L6\n"
+            "L1 : R2- -> L2, L4\n"
+            "L2 : R0+ -> L3\n"
+            "L3 : R3+ -> L1\n"
+            "L4 : R3- -> L5, L0\n"
+            "L5 : R2+ -> L4\n"
+            "L6 : HALT") };
+    
+    ctrm::trace::nameThread("main");
+    
+    {
+        const ctrm::trace::span span{ "example" };
+        std::cout << ctrm::run<std::uint64_t>(multiply, 0, 6, 7) << '\n';
+        
+        const ctrm::image p{ multiply };
+        std::vector<std::uint64_t> values(2048 * 4);
+        
+        for (std::size_t row{ 0 }; row < 2048; ++row)
+        {
+            values[row * 4 + 1] = row % 32;
+            values[row * 4 + 2] = row / 32;
+        }
+        
+        static_cast<void>(ctrm::runBatch<std::uint64_t>(p, values, 4, std::numeric_limits<std::size_t>::max(), 4));
+    }
+    
+    if (!ctrm::trace::writeFile("trace.json"))
+        return 1;
+    
+    std::ifstream file{ "trace.json" };
+    const std::string trace{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+    std::string_view rest{ trace };
+    const bool valid{ skipValue(rest) && rest.find_first_not_of(" \n") == std::string_view::npos };
+    
+    std::cout << valid << ' ' << occurrences(trace, "\"name\":\"example\"") << ' '
+              << occurrences(trace, "\"name\":\"run\"") << ' ' << occurrences(trace, "\"name\":\"batch\"") << ' '
+              << occurrences(trace, "\"name\":\"task\"") << ' ' << occurrences(trace, "\"thread_name\"") << '\n';
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <ranges>
+
+#include "../ctrm/views.hpp"
+
+//  Adds 2i to i for every i, lazily, until the sum reaches 300. Only the two
+//  chunks of 64 inputs needed are ever executed.
+int main()
+{
+    constexpr auto add{ ctrm::make<3, 5>(
+            "L0 : R1- -> L1, L2\n"
+            "L1 : R0+ -> L0\n"
+            "L2 : R2- -> L3, L4\n"
+            "L3 : R0+ -> L2\n"
+            "L4 : HALT") };
+    
+    std::size_t pulled{ 0 };
+    std::size_t count{ 0 };
+    std::uint64_t last{ 0 };
+    
+    auto inputs{ std::views::iota(std::uint64_t{ 0 }) | std::views::transform([&](std::uint64_t i) {
+        ++pulled;
+        return std::array<std::uint64_t, 3>{ 0, i, 2 * i };
+    }) };
+    
+    for (const std::uint64_t sum : inputs | ctrm::views::evaluate(add, 64)
+                                          | std::views::take_while([](std::uint64_t s) { return s < 300; }))
+    {
+        ++count;
+        last = sum;
+    }
+    
+    std::cout << count << ' ' << last << ' ' << pulled << '\n';
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <span>
+
+#include "../ctrm/runtime.hpp"
+
+//  Counts R1 down from the largest value of an 8-bit register while
+//  incrementing R0, which wraps around to zero on the last iteration. The
+//  loop is executed in bulk, and must still leave through the decrement to
+//  the halt. Prints R0, the final location and the number of steps.
+int main()
+{
+    constexpr auto p{ ctrm::make<2, 3>(
+            "L0 : R0+ -> L1\n"
+            "L1 : R1- -> L0, L2\n"
+            "L2 : HALT") };
+    
+    static_assert(p.exec<std::uint8_t>(0, 255) == 0);
+    
+    std::array<std::uint8_t, 2> values{ 0, 255 };
+    const auto result{ ctrm::run<std::uint8_t>(p, std::span{ values }) };
+    
+    std::cout << +values[0] << ' ' << result.location << ' ' << result.steps << '\n';
+    return 0;
+}
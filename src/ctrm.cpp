@@ -0,0 +1,183 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+#include <cstdio>
+#include <limits>
+#include <new>
+#include <stdexcept>
+
+#include "../ctrm/ctrm.h"
+#include "../ctrm/runtime.hpp"
+
+struct ctrm_program
+{
+    ctrm::image image;
+    std::size_t fuel{ std::numeric_limits<std::size_t>::max() };
+};
+
+namespace
+{
+    //  A fixed buffer, so that reporting an error does not allocate
+    thread_local char lastError[256];
+    
+    void setError(const char* message)
+    {
+        std::snprintf(lastError, sizeof(lastError), "%s", message);
+    }
+    
+    //  Converts exceptions into result codes, as they must not cross the C
+    //  interface.
+    template<typename Function>
+    ctrm_result guard(ctrm_result onInvalid, Function f)
+    {
+        try
+        {
+            return f();
+        }
+        catch (const std::bad_alloc&)
+        {
+            setError("out of memory");
+            return CTRM_OUT_OF_MEMORY;
+        }
+        catch (const std::exception& e)
+        {
+            setError(e.what());
+            return onInvalid;
+        }
+    }
+    
+    void fill(ctrm_stats* stats, std::uint64_t runs, std::uint64_t steps, std::uint64_t outOfFuel)
+    {
+        if (stats != nullptr)
+            *stats = { runs, steps, outOfFuel };
+    }
+}
+
+extern "C"
+{
+    ctrm_result ctrm_load_text(const char* text, size_t length, ctrm_program** program)
+    {
+        if (text == nullptr || program == nullptr)
+        {
+            setError("null text or program");
+            return CTRM_INVALID_ARGUMENT;
+        }
+        
+        return guard(CTRM_SYNTAX_ERROR, [&] {
+            *program = new ctrm_program{ ctrm::load({ text, length }) };
+            return CTRM_OK;
+        });
+    }
+    
+    ctrm_result ctrm_load_binary(const void* data, size_t size, ctrm_program** program)
+    {
+        if (data == nullptr || program == nullptr)
+        {
+            setError("null data or program");
+            return CTRM_INVALID_ARGUMENT;
+        }
+        
+        return guard(CTRM_INVALID_IMAGE, [&] {
+            *program = new ctrm_program{ ctrm::loadBinary({ static_cast<const std::byte*>(data), size }) };
+            return CTRM_OK;
+        });
+    }
+    
+    size_t ctrm_save_binary(const ctrm_program* program, void* buffer, size_t size)
+    {
+        if (program == nullptr)
+            return 0;
+        
+        if (buffer == nullptr)
+            size = 0;
+        
+        return ctrm::saveBinary(program->image, { static_cast<std::byte*>(buffer), size });
+    }
+    
+    void ctrm_free(ctrm_program* program)
+    {
+        delete program;
+    }
+    
+    size_t ctrm_register_count(const ctrm_program* program)
+    {
+        return program == nullptr ? 0 : program->image.registerCount;
+    }
+    
+    size_t ctrm_instruction_count(const ctrm_program* program)
+    {
+        return program == nullptr ? 0 : program->image.instructions.size();
+    }
+    
+    void ctrm_set_fuel(ctrm_program* program, uint64_t fuel)
+    {
+        if (program != nullptr)
+            program->fuel = fuel == 0 ? std::numeric_limits<std::size_t>::max() : fuel;
+    }
+    
+    ctrm_result ctrm_run(const ctrm_program* program, uint64_t* registers, size_t count, ctrm_stats* stats)
+    {
+        if (program == nullptr || registers == nullptr)
+        {
+            setError("null program or registers");
+            return CTRM_INVALID_ARGUMENT;
+        }
+        
+        if (count < program->image.registerCount)
+        {
+            setError("not enough registers for program");
+            return CTRM_INVALID_ARGUMENT;
+        }
+        
+        return guard(CTRM_INVALID_ARGUMENT, [&] {
+            const auto s{ ctrm::run<std::uint64_t>(program->image, { registers, count }, program->fuel) };
+            fill(stats, 1, s.steps, !s.halted);
+            return s.halted ? CTRM_OK : CTRM_OUT_OF_FUEL;
+        });
+    }
+    
+    ctrm_result ctrm_run_batch(const ctrm_program* program, uint64_t* registers, size_t stride, size_t rows,
+                               unsigned threads, ctrm_stats* stats)
+    {
+        if (program == nullptr || (registers == nullptr && rows > 0))
+        {
+            setError("null program or registers");
+            return CTRM_INVALID_ARGUMENT;
+        }
+        
+        if (stride < program->image.registerCount)
+        {
+            setError("not enough registers for program");
+            return CTRM_INVALID_ARGUMENT;
+        }
+        
+        if (rows > std::numeric_limits<std::size_t>::max() / stride)
+        {
+            setError("too many registers for a batch");
+            return CTRM_INVALID_ARGUMENT;
+        }
+        
+        return guard(CTRM_INVALID_ARGUMENT, [&] {
+            const auto s{ ctrm::runBatch<std::uint64_t>(program->image, { registers, stride * rows }, stride,
+                                                        program->fuel, threads) };
+            fill(stats, s.runs, s.steps, s.exhausted);
+            return s.exhausted == 0 ? CTRM_OK : CTRM_OUT_OF_FUEL;
+        });
+    }
+    
+    const char* ctrm_last_error(void)
+    {
+        return lastError;
+    }
+}
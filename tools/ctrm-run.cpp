@@ -0,0 +1,228 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+//  Executes a register machine program, in the text format or as a binary
+//  image written by ctrmc, at run-time. The initial values of the registers
+//  are given as arguments, and the value of the first register is printed
+//  once the program halts. With --batch, each line of standard input holds
+//  the initial registers of one execution, and the executions are run in
+//  parallel; --deduplicate executes identical rows once and --cost-order
+//  starts the rows predicted to be most expensive first. With --fused, the
+//  program is executed with superinstructions.
+//  With --dot, the program is profiled and its control-flow graph is written
+//  to a file ("-" for standard output, in place of the first register) in
+//  the Graphviz DOT format, drawing each loop as a single node with
+//  --components. With --stream, rows of 64-bit registers are read from a
+//  binary input file and the first register of each row is written to an
+//  output file, for batches larger than memory.
+//
+//  Usage: ctrm-run [--fuel n] [--threads n] [--batch [--deduplicate] [--cost-order]] [--fused]
+//                  [--dot file [--components]] [--stream input output] program [registers...]
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../ctrm/graph.hpp"
+
+#if __has_include(<fcntl.h>) && __has_include(<unistd.h>)
+#include <fcntl.h>
+
+#include "../ctrm/stream.hpp"
+#define CTRM_RUN_HAS_STREAM 1
+#endif
+
+namespace
+{
+    ctrm::image read(const std::string& path)
+    {
+        std::ifstream file{ path, std::ios::binary };
+        const std::string data{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+        
+        if (!file)
+            throw std::invalid_argument("cannot read " + path);
+        
+        if (data.starts_with("CTRM"))
+            return ctrm::loadBinary(std::as_bytes(std::span{ data }));
+        
+        return ctrm::load(data);
+    }
+    
+    //  Parses a whole argument as an unsigned number. Throws
+    //  std::invalid_argument if it is anything else.
+    std::uint64_t number(const char* text)
+    {
+        const char* end{ text + std::strlen(text) };
+        std::uint64_t value{ 0 };
+        const auto [last, error]{ std::from_chars(text, end, value) };
+        
+        if (error != std::errc{} || last != end)
+            throw std::invalid_argument(std::string{ "invalid number " } + text);
+        
+        return value;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t fuel{ std::numeric_limits<std::size_t>::max() };
+    unsigned threads{ 0 };
+    bool batch{ false };
+    bool deduplicate{ false };
+    bool costOrder{ false };
+    bool fused{ false };
+    std::string dot;
+    std::string streamInput;
+    std::string streamOutput;
+    ctrm::dotOptions options;
+    std::string path;
+    std::vector<std::uint64_t> values;
+    
+    try
+    {
+        for (int i{ 1 }; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], "--fuel") == 0 && i + 1 < argc)
+                fuel = number(argv[++i]);
+            else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                threads = static_cast<unsigned>(number(argv[++i]));
+            else if (std::strcmp(argv[i], "--batch") == 0)
+                batch = true;
+            else if (std::strcmp(argv[i], "--deduplicate") == 0)
+                deduplicate = true;
+            else if (std::strcmp(argv[i], "--cost-order") == 0)
+                costOrder = true;
+            else if (std::strcmp(argv[i], "--fused") == 0)
+                fused = true;
+            else if (std::strcmp(argv[i], "--dot") == 0 && i + 1 < argc)
+                dot = argv[++i];
+            else if (std::strcmp(argv[i], "--components") == 0)
+                options.collapseComponents = true;
+            else if (std::strcmp(argv[i], "--stream") == 0 && i + 2 < argc)
+            {
+                streamInput = argv[++i];
+                streamOutput = argv[++i];
+            }
+            else if (path.empty())
+                path = argv[i];
+            else
+                values.push_back(number(argv[i]));
+        }
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << "ctrm-run: " << e.what() << '\n';
+        path.clear();
+    }
+    
+    if (path.empty())
+    {
+        std::cerr << "usage: ctrm-run [--fuel n] [--threads n] [--batch [--deduplicate] [--cost-order]] [--fused] "
+                     "[--dot file [--components]] [--stream input output] program [registers...]\n";
+        return 2;
+    }
+    
+    try
+    {
+        const ctrm::image p{ read(path) };
+        
+#ifdef CTRM_RUN_HAS_STREAM
+        if (!streamInput.empty())
+        {
+            const int input{ ::open(streamInput.c_str(), O_RDONLY) };
+            const int output{ ::open(streamOutput.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) };
+            
+            if (input < 0 || output < 0)
+                throw std::invalid_argument("cannot open " + (input < 0 ? streamInput : streamOutput));
+            
+            ctrm::streamOptions stream;
+            stream.fuel = fuel;
+            stream.threads = threads;
+            const auto s{ ctrm::runStream(p, input, output, p.registerCount, stream) };
+            ::close(input);
+            
+            if (::close(output) != 0)
+                throw std::invalid_argument("cannot write " + streamOutput);
+            
+            return s.exhausted == 0 ? 0 : 3;
+        }
+#endif
+        
+        if (!dot.empty())
+        {
+            values.resize(std::max(values.size(), p.registerCount));
+            std::vector<std::size_t> zeros(p.instructions.size());
+            ctrm::status s;
+            const auto counts{ ctrm::profile<std::uint64_t>(p, values, fuel, zeros, s) };
+            
+            if (dot == "-")
+            {
+                ctrm::toDot(std::cout, p, counts, zeros, options);
+            }
+            else
+            {
+                std::ofstream out{ dot };
+                ctrm::toDot(out, p, counts, zeros, options);
+                
+                if (!out.flush())
+                    throw std::runtime_error("cannot write " + dot);
+                
+                std::cout << values[0] << '\n';
+            }
+            
+            return s.halted ? 0 : 3;
+        }
+        
+        if (!batch)
+        {
+            values.resize(std::max(values.size(), p.registerCount));
+            const auto s{ fused ? ctrm::run<std::uint64_t>(ctrm::fuse(p), values, fuel)
+                                : ctrm::run<std::uint64_t>(p, values, fuel) };
+            std::cout << values[0] << '\n';
+            return s.halted ? 0 : 3;
+        }
+        
+        const std::size_t stride{ p.registerCount };
+        values.clear();
+        
+        for (std::string line; std::getline(std::cin, line);)
+        {
+            std::istringstream in{ line };
+            const std::size_t row{ values.size() };
+            values.resize(row + stride);
+            
+            for (std::size_t i{ 0 }; i < stride && in >> values[row + i]; ++i);
+        }
+        
+        const auto s{ ctrm::runBatch<std::uint64_t>(p, values, stride, { fuel, threads, deduplicate, costOrder }) };
+        
+        for (std::size_t row{ 0 }; row < values.size(); row += stride)
+            std::cout << values[row] << '\n';
+        
+        return s.exhausted == 0 ? 0 : 3;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << path << ": " << e.what() << '\n';
+        return 1;
+    }
+}
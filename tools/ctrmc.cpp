@@ -0,0 +1,136 @@
+//  Copyright (c) 2021 Peter Wild
+//
+//  Permission to use, copy, modify, and/or distribute this software for any
+//  purpose with or without fee is hereby granted.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+//  REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+//  INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+//  LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+//  OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+//  PERFORMANCE OF THIS SOFTWARE.
+
+
+//  Compiles a register machine program in the text format into either a
+//  binary image, which can be loaded at run-time without parsing, or a C++
+//  header defining the program as a constexpr ctrm::program, so that large
+//  programs do not need to be embedded as string literals. With -O, the
+//  program is optimised before it is written (see ctrm/optimise.hpp). Only
+//  the first n registers are kept with --inputs n, and the others must
+//  start at zero; by default every register is kept.
+//
+//  Usage: ctrmc [-O [--inputs n]] [--header name] -o output input
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "../ctrm/optimise.hpp"
+
+namespace
+{
+    void writeHeader(std::ostream& out, const ctrm::image& p, const std::string& name)
+    {
+        out << "// Generated by ctrmc. Do not edit.\n"
+            << "#pragma once\n\n"
+            << "#include <array>\n\n"
+            << "#include <ctrm.hpp>\n\n"
+            << "inline constexpr ctrm::program<" << p.registerCount << ", " << p.instructions.size() << "> "
+            << name << "{ std::array<ctrm::impl::instruction, " << p.instructions.size() << ">{ {\n";
+        
+        for (const auto& ins : p.instructions)
+        {
+            out << "        { ";
+            
+            if (ins.type == ctrm::impl::INCR)
+                out << ins.currentRegister << "u, " << ins.location1 << "u ";
+            else if (ins.type == ctrm::impl::DECR)
+                out << ins.currentRegister << "u, " << ins.location1 << "u, " << ins.location2 << "u ";
+            
+            out << "},\n";
+        }
+        
+        out << "} } };\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string header;
+    std::string output;
+    std::string input;
+    bool optimise{ false };
+    std::size_t inputs{ std::numeric_limits<std::size_t>::max() };
+    
+    for (int i{ 1 }; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--header") == 0 && i + 1 < argc)
+            header = argv[++i];
+        else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (std::strcmp(argv[i], "-O") == 0)
+            optimise = true;
+        else if (std::strcmp(argv[i], "--inputs") == 0 && i + 1 < argc)
+            inputs = std::strtoull(argv[++i], nullptr, 10);
+        else
+            input = argv[i];
+    }
+    
+    if (input.empty() || output.empty())
+    {
+        std::cerr << "usage: ctrmc [-O [--inputs n]] [--header name] -o output input\n";
+        return 2;
+    }
+    
+    std::ifstream file{ input, std::ios::binary };
+    const std::string text{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+    
+    if (!file)
+    {
+        std::cerr << "ctrmc: cannot read " << input << '\n';
+        return 1;
+    }
+    
+    ctrm::image p;
+    
+    try
+    {
+        p = ctrm::load(text);
+        
+        if (optimise)
+            p = ctrm::propagate(ctrm::merge(p), inputs);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << input << ": " << e.what() << '\n';
+        return 1;
+    }
+    
+    std::ofstream out{ output, std::ios::binary | std::ios::trunc };
+    
+    if (!header.empty())
+    {
+        writeHeader(out, p, header);
+    }
+    else
+    {
+        std::vector<std::byte> bytes(ctrm::saveBinary(p, {}));
+        ctrm::saveBinary(p, bytes);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+    
+    if (!out.flush())
+    {
+        std::cerr << "ctrmc: cannot write " << output << '\n';
+        return 1;
+    }
+    
+    return 0;
+}